@@ -0,0 +1,20 @@
+#ifndef AUNF_H
+#define AUNF_H
+
+/* Everything a program linking libaunf needs: build a Net with the
+   createArc functions or read one with read_pep_net or read_pep_buffer,
+   give it to an Unfolder, optionally with an UnfoldListener, and call
+   unfold(). The prefix is then in Unfolder::unf, and the writers of
+   output.h, CoRelation and Checker work on it as for the command line
+   tool. Errors in the input still end the process, as they do in the
+   tool. */
+
+#include "net.h"
+#include "readpep.h"
+#include "unf.h"
+#include "corel.h"
+#include "check.h"
+#include "progress.h"
+#include "output.h"
+
+#endif
@@ -0,0 +1,407 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <cstring>
+#include <vector>
+#include <time.h>
+
+#include "readpep.h"
+#include "readlib.h"
+#include "unf.h"
+#include "order.h"
+#include "output.h"
+#include "families.h"
+#include "corel.h"
+#include "progress.h"
+
+#include <unistd.h>
+
+using namespace std;
+
+void usage() {
+    cerr <<
+"Usage: aunf-bench [parameters] file_name...\n\n"
+"Parameters:\n"
+"        -pairs n     Number of history pairs checked per net (default 100000)\n"
+"        -timeout n   Stop unfolding each net after n seconds and check pairs\n"
+"                     of the histories found so far\n"
+"        -micro       Time the basic operations instead: co-sets, histories,\n"
+"                     the co-relation, markings, reading and writing nets\n"
+"        -parse       With -micro, only time reading and writing the nets\n"
+"        -sweep family from to Unfold the generated nets of the family (see\n"
+"                     aunf-gen) for n from 'from' to 'to', and report time\n"
+"                     and memory for each n\n"
+"        -writers n, -states n, -read r, -seed n\n"
+"                     Parameters of the generated nets, as in aunf-gen\n";
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Bytes requested through operator new, for the bytes/op figures. Memory
+   the C reader gets from malloc is not counted. */
+static size_t allocated = 0;
+
+void *operator new(size_t n) {
+    allocated += n;
+    void *p = malloc(n? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t n) {
+    return operator new(n);
+}
+
+void operator delete(void *p) throw() {
+    free(p);
+}
+
+void operator delete[](void *p) throw() {
+    free(p);
+}
+
+void operator delete(void *p, size_t) throw() {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) throw() {
+    free(p);
+}
+
+/* Results of timed loops are stored here so that they are not optimized
+   away. */
+static volatile uint sink;
+
+/* Time and allocation between start() and stop(), reported per op. */
+class Meter {
+public:
+    void start() { bytes = allocated; t = now(); }
+    void stop(const char *what, double ops) {
+        double dt = now() - t;
+        size_t db = allocated - bytes;
+        if (ops < 1)
+            ops = 1;
+        cout << "  " << what << ": " << dt / ops << " ns/op, "
+             << db / ops << " bytes/op (" << (unsigned long long) ops << " ops)" << endl;
+    }
+
+private:
+    double t;
+    size_t bytes;
+};
+
+static unsigned long long rnd = 1;
+
+static uint random(uint n) {
+    rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (rnd >> 33) % n;
+}
+
+/* Co-sets of enriched conditions drawn from a fixed universe, at a few
+   densities: building them, and intersecting and joining pairs. */
+static void benchCoset() {
+    const uint universe = 4096, sets = 64;
+    vector<EnrichedCond *> ecs;
+    for (uint i = 0; i < universe; i++)
+        ecs.push_back(new EnrichedCond(i, 0, 0));
+
+    const double density[] = { 0.01, 0.1, 0.5 };
+    for (uint d = 0; d < 3; d++) {
+        cout << "co-sets, density " << density[d] << ":" << endl;
+        Meter m;
+        vector<Coset> cs(sets);
+        uint n = universe * density[d];
+        m.start();
+        for (uint k = 0; k < sets; k++)
+            for (uint i = 0; i < n; i++)
+                cs[k].insert(ecs[random(universe)]);
+        m.stop("insert", (double) sets * n);
+
+        m.start();
+        for (uint k = 0; k < sets; k++)
+            for (uint l = 0; l < sets; l++) {
+                Coset r;
+                set_intersection(cs[k].begin(), cs[k].end(), cs[l].begin(), cs[l].end(),
+                                 inserter(r, r.end()));
+            }
+        m.stop("intersect", (double) sets * sets);
+
+        m.start();
+        for (uint k = 0; k < sets; k++)
+            for (uint l = 0; l < sets; l++) {
+                Coset r;
+                set_union(cs[k].begin(), cs[k].end(), cs[l].begin(), cs[l].end(),
+                          inserter(r, r.end()));
+            }
+        m.stop("union", (double) sets * sets);
+    }
+    for (uint i = 0; i < universe; i++)
+        delete ecs[i];
+}
+
+/* The tokenizer and the reader on a whole file, per input byte, and the
+   writers on the net read, per output byte. */
+static Net *benchParse(char *file) {
+    Meter m;
+    FILE *f = fopen(file, "r");
+    if (!f) {
+        cerr << "could not open " << file << "\n";
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    cout << file << ": " << size << " bytes" << endl;
+
+    m.start();
+    while (!feof(f))
+        ReadCharComment(f);
+    m.stop("tokenizer (per byte)", size);
+    fclose(f);
+
+    m.start();
+    Net *net = read_pep_net(file);
+    m.stop("read_pep_net (per byte)", size);
+
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    m.start();
+    read_pep_net_parallel(file, threads);
+    m.stop("read_pep_net_parallel (per byte)", size);
+
+    const uint rounds = 5;
+    ostringstream out;
+    m.start();
+    for (uint r = 0; r < rounds; r++) {
+        out.str("");
+        writeLL(out, net);
+    }
+    m.stop("writeLL (per byte)", (double) rounds * out.str().size());
+
+    m.start();
+    for (uint r = 0; r < rounds; r++) {
+        out.str("");
+        writeDot(out, net);
+    }
+    m.stop("writeDot (per byte)", (double) rounds * out.str().size());
+    return net;
+}
+
+/* Histories created by a whole unfolding, then the operations on the
+   finished prefix: the co-relation of its conditions, per pair, and the
+   marking table. */
+static void benchUnfold(Net *net) {
+    Meter m;
+    Unfolder *unf = new Unfolder();
+    unf->net = net;
+    m.start();
+    unf->unfold();
+    m.stop("history creation", unf->histories);
+
+    double conds = unf->unf->conditions.size();
+    CoRelation co;
+    m.start();
+    co.build(unf->unf, 1);
+    m.stop("co-relation (per pair)", conds * (conds - 1) / 2);
+
+    vector<Hist *> hists;
+    for (uint i = 1; i < unf->unf->events.size(); i++) {
+        Event *e = unf->unf->events[i];
+        hists.insert(hists.end(), e->hist.begin(), e->hist.end());
+    }
+    uint sum = 0;
+    m.start();
+    for (uint i = 0; i < hists.size(); i++)
+        sum += hists[i]->marking.hash();
+    m.stop("marking hash", hists.size());
+    sink = sum;
+
+    MarkingTable table;
+    m.start();
+    for (uint i = 0; i < hists.size(); i++)
+        if (!table.find(hists[i]->marking))
+            table.insert(hists[i]->marking, hists[i]);
+    m.stop("marking insert", hists.size());
+
+    uint found = 0;
+    m.start();
+    for (uint i = 0; i < hists.size(); i++)
+        found += table.find(hists[i]->marking) != 0;
+    m.stop("marking lookup", hists.size());
+    if (found != hists.size())
+        cout << "  (" << found << " markings found)" << endl;
+}
+
+/* Check whether the union of two histories is free of asymmetric conflict
+   cycles, once from scratch and once through an AsymOrder. With a limit,
+   the pairs come from the part of the prefix unfolded in that time. */
+static void benchAsymOrder(char *file, uint pairs, uint limit) {
+    Net *net = read_pep_net(file);
+    Unfolder *unf = new Unfolder();
+    unf->net = net;
+    Monitor monitor(unf);
+    monitor.limit = limit;
+    if (limit)
+        monitor.start();
+    unf->unfold();
+    if (limit)
+        monitor.stop();
+
+    vector<Hist *> hists;
+    for (uint i = 1; i < unf->unf->events.size(); i++) {
+        Event *e = unf->unf->events[i];
+        hists.insert(hists.end(), e->hist.begin(), e->hist.end());
+    }
+    if (hists.size() < 2) {
+        cerr << file << ": not enough histories\n";
+        return;
+    }
+
+    vector<pair<Hist *, Hist *> > sample;
+    unsigned long long r = 1;
+    for (uint k = 0; k < pairs; k++) {
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        Hist *a = hists[(r >> 33) % hists.size()];
+        r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+        Hist *b = hists[(r >> 33) % hists.size()];
+        /* Only pairs that pass the conflict labels reach the cycle check. */
+        if (!a->conflict.intersects(b->events) && !b->conflict.intersects(a->events))
+            sample.push_back(make_pair(a, b));
+    }
+
+    uint cyclic = 0, disagree = 0;
+    vector<bool> scratch(sample.size());
+    double t0 = now();
+    for (uint k = 0; k < sample.size(); k++) {
+        BitVector u = sample[k].first->events;
+        u |= sample[k].second->events;
+        scratch[k] = unf->unf->sequence(u, 0);
+    }
+    double t1 = now();
+    AsymOrder order(unf->unf);
+    for (uint k = 0; k < sample.size(); k++) {
+        order.undo(0);
+        bool ok = order.add(sample[k].first) && order.add(sample[k].second);
+        if (!ok) cyclic++;
+        if (ok != scratch[k]) disagree++;
+    }
+    double t2 = now();
+
+    uint n = sample.size()? sample.size() : 1;
+    cout << file << ": " << hists.size() << " histories"
+         << (unf->interrupted()? " (stopped)" : "") << ", "
+         << sample.size() << " pairs, " << cyclic << " cyclic" << endl
+         << "  from scratch: " << (t1 - t0) / n << " ns/check" << endl
+         << "  incremental:  " << (t2 - t1) / n << " ns/check" << endl;
+    if (disagree)
+        cout << "  DISAGREEMENTS: " << disagree << endl;
+}
+
+/* The generated nets are written out and read back, so that they are
+   unfolded exactly as aunf would unfold the files of aunf-gen. */
+static void sweep(const char *family, uint from, uint to, const FamilyOptions &opt) {
+    char file[] = "/tmp/aunf-sweep-XXXXXX";
+    int fd = mkstemp(file);
+    if (fd < 0) {
+        cerr << "could not create a temporary file\n";
+        exit(1);
+    }
+    close(fd);
+    cout << "n\tplaces\ttrans\tevents\thistories\tms\tbytes" << endl;
+    for (uint n = from; n <= to; n++) {
+        Net *net = generateNet(family, n, opt);
+        if (!net) {
+            cerr << "unknown family or size!\n";
+            exit(1);
+        }
+        {
+            ofstream out(file);
+            writeLL(out, net);
+        }
+        net = read_pep_net(file);
+        size_t bytes = allocated;
+        double t = now();
+        Unfolder *unf = new Unfolder();
+        unf->net = net;
+        unf->unfold();
+        t = now() - t;
+        cout << n << "\t" << net->places.size() << "\t" << net->transitions.size()
+             << "\t" << unf->unf->events.size() - 1 << "\t" << unf->histories
+             << "\t" << t / 1e6 << "\t" << allocated - bytes << endl;
+    }
+    unlink(file);
+}
+
+int main(int argc, char **argv) {
+    uint pairs = 100000, limit = 0;
+    bool any = false, micro = false, parse = false;
+    FamilyOptions opt;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-pairs") == 0) {
+            i++;
+            if (i < argc && atoi(argv[i]) > 0)
+                pairs = atoi(argv[i]);
+            else {
+                cerr << "number of pairs not specified!\n";
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "-timeout") == 0) {
+            i++;
+            if (i < argc && atoi(argv[i]) > 0)
+                limit = atoi(argv[i]);
+            else {
+                cerr << "time limit not specified!\n";
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "-micro") == 0) {
+            micro = any = true;
+            benchCoset();
+        }
+        else if (strcmp(argv[i], "-parse") == 0)
+            parse = true;
+        else if (strcmp(argv[i], "-sweep") == 0) {
+            i += 3;
+            if (i < argc) {
+                sweep(argv[i - 2], atoi(argv[i - 1]), atoi(argv[i]), opt);
+                any = true;
+            } else {
+                cerr << "family and sizes not specified!\n";
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "-writers") == 0 && i + 1 < argc)
+            opt.writers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-states") == 0 && i + 1 < argc)
+            opt.states = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-read") == 0 && i + 1 < argc)
+            opt.read = atof(argv[++i]);
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+            opt.seed = strtoull(argv[++i], 0, 10);
+        else if (argv[i][0] == '-') {
+            cerr << "option not recognized!\n";
+            exit(1);
+        } else {
+            if (!micro)
+                benchAsymOrder(argv[i], pairs, limit);
+            else {
+                Net *net = benchParse(argv[i]);
+                if (!parse)
+                    benchUnfold(net);
+            }
+            any = true;
+        }
+    }
+    if (!any)
+        usage();
+    return 0;
+}
@@ -0,0 +1,115 @@
+#ifndef BITVEC_H
+#define BITVEC_H
+
+#include "common.h"
+
+#include <vector>
+
+using namespace std;
+
+/* A growable bit vector, used for sets of events, places and conditions
+   indexed by their id. Bits beyond the allocated words read as zero. */
+class BitVector {
+public:
+    typedef unsigned long word;
+    enum { WORD_BITS = sizeof(word) * 8 };
+
+    vector<word> words;
+
+    BitVector() {}
+    BitVector(uint bits): words((bits + WORD_BITS - 1) / WORD_BITS, 0) {}
+
+    void set(uint i) {
+        uint w = i / WORD_BITS;
+        if (w >= words.size())
+            words.resize(w + 1, 0);
+        words[w] |= (word)1 << (i % WORD_BITS);
+    }
+
+    void reset(uint i) {
+        uint w = i / WORD_BITS;
+        if (w < words.size())
+            words[w] &= ~((word)1 << (i % WORD_BITS));
+    }
+
+    bool test(uint i) const {
+        uint w = i / WORD_BITS;
+        return w < words.size() && (words[w] >> (i % WORD_BITS)) & 1;
+    }
+
+    /* Number of set bits. */
+    uint count() const {
+        uint n = 0;
+        for (uint i = 0; i < words.size(); i++)
+            n += __builtin_popcountl(words[i]);
+        return n;
+    }
+
+    bool intersects(const BitVector &o) const {
+        uint n = words.size() < o.words.size()? words.size() : o.words.size();
+        for (uint i = 0; i < n; i++)
+            if (words[i] & o.words[i])
+                return true;
+        return false;
+    }
+
+    /* Whether every bit set in o is set here too. */
+    bool includes(const BitVector &o) const {
+        for (uint i = 0; i < o.words.size(); i++)
+            if (o.words[i] & ~(i < words.size()? words[i] : 0))
+                return false;
+        return true;
+    }
+
+    BitVector &operator|=(const BitVector &o) {
+        if (o.words.size() > words.size())
+            words.resize(o.words.size(), 0);
+        for (uint i = 0; i < o.words.size(); i++)
+            words[i] |= o.words[i];
+        return *this;
+    }
+
+    /* Index of the first set bit at position >= i, or -1 if there is none. */
+    int next(uint i) const {
+        uint w = i / WORD_BITS;
+        if (w >= words.size())
+            return -1;
+        word cur = words[w] & (~(word)0 << (i % WORD_BITS));
+        for (;;) {
+            if (cur)
+                return w * WORD_BITS + __builtin_ctzl(cur);
+            if (++w >= words.size())
+                return -1;
+            cur = words[w];
+        }
+    }
+
+    /* Equality ignores trailing zero words. */
+    bool operator==(const BitVector &o) const {
+        const vector<word> &a = words.size() < o.words.size()? words : o.words;
+        const vector<word> &b = words.size() < o.words.size()? o.words : words;
+        for (uint i = 0; i < a.size(); i++)
+            if (a[i] != b[i])
+                return false;
+        for (uint i = a.size(); i < b.size(); i++)
+            if (b[i])
+                return false;
+        return true;
+    }
+
+    uint hash() const {
+        uint h = 0;
+        uint n = words.size();
+        while (n > 0 && !words[n - 1])
+            n--;
+        for (uint i = 0; i < n; i++)
+            h = h * 0x9e3779b1u + (uint)(words[i] ^ (words[i] >> 32));
+        return h;
+    }
+
+    size_t memory() const {
+        return words.capacity() * sizeof(word);
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#define CACHE_MAGIC "AUNFCACHE1"
+#define ENTRY_SUFFIX ".entry"
+/* Temporary files older than this were left by a process that died. */
+#define STALE_SECONDS 3600
+
+/* Two FNV-1a hashes with different offset bases, as 32 hex digits. */
+static string digest(const string &s)
+{
+    unsigned long long a = 14695981039346656037ULL, b = 0x6c62272e07bb0142ULL;
+    for (uint i = 0; i < s.size(); i++) {
+        a = (a ^ (uchar) s[i]) * 1099511628211ULL;
+        b = (b ^ (uchar) s[s.size() - 1 - i]) * 1099511628211ULL;
+    }
+    char buf[33];
+    sprintf(buf, "%016llx%016llx", a, b);
+    return buf;
+}
+
+template <class T> static bool byId(const T *a, const T *b)
+{
+    return a->id < b->id;
+}
+
+static void ids(const list<Place *> &arcs, ostream &out)
+{
+    vector<uint> v;
+    for (list<Place *>::const_iterator p = arcs.begin(); p != arcs.end(); p++)
+        v.push_back((*p)->id);
+    sort(v.begin(), v.end());
+    out << v.size();
+    for (uint i = 0; i < v.size(); i++)
+        out << ' ' << v[i];
+    out << '\n';
+}
+
+string netDigest(const Net *net)
+{
+    vector<Place *> places(net->places.begin(), net->places.end());
+    vector<Trans *> trans(net->transitions.begin(), net->transitions.end());
+    sort(places.begin(), places.end(), byId<Place>);
+    sort(trans.begin(), trans.end(), byId<Trans>);
+
+    ostringstream s;
+    s << places.size() << '\n';
+    for (uint i = 0; i < places.size(); i++)
+        s << places[i]->id << ' ' << (int) places[i]->mark << ' '
+          << places[i]->name.size() << ' ' << places[i]->name << '\n';
+    s << trans.size() << '\n';
+    for (uint i = 0; i < trans.size(); i++) {
+        s << trans[i]->id << ' ' << trans[i]->name.size() << ' ' << trans[i]->name << '\n';
+        ids(trans[i]->pre, s);
+        ids(trans[i]->post, s);
+        ids(trans[i]->read, s);
+    }
+    return digest(s.str());
+}
+
+Cache::Cache(const string &dir, size_t limit): dir(dir), limit(limit)
+{
+    mkdir(dir.c_str(), 0777);
+}
+
+string Cache::path(const string &key) const
+{
+    return dir + "/" + digest(key) + ENTRY_SUFFIX;
+}
+
+static bool readString(istream &in, string &s)
+{
+    size_t n;
+    if (!(in >> n) || in.get() != '\n')
+        return false;
+    s.resize(n);
+    return n == 0 || in.read(&s[0], n);
+}
+
+static void writeString(ostream &out, const string &s)
+{
+    out << s.size() << '\n';
+    out.write(s.data(), s.size());
+}
+
+/* The whole key is stored with the entry, so that two keys with the same
+   digest are told apart. */
+bool Cache::get(const string &key, Entry &entry)
+{
+    string p = path(key), magic, k, end;
+    ifstream in(p.c_str(), ios::binary);
+    uint n;
+    if (!getline(in, magic) || magic != CACHE_MAGIC || !readString(in, k) || k != key
+            || !(in >> n))
+        return false;
+    entry.clear();
+    for (uint i = 0; i < n; i++) {
+        string name, data;
+        if (!readString(in, name) || !readString(in, data))
+            return false;
+        entry[name] = data;
+    }
+    if (!(in >> end) || end != "end")
+        return false;
+    utime(p.c_str(), 0);
+    return true;
+}
+
+void Cache::put(const string &key, const Entry &entry)
+{
+    static uint count = 0;
+    ostringstream tmp;
+    tmp << dir << "/tmp." << getpid() << "." << count++;
+    {
+        ofstream out(tmp.str().c_str(), ios::binary);
+        out << CACHE_MAGIC << '\n';
+        writeString(out, key);
+        out << entry.size() << '\n';
+        for (Entry::const_iterator it = entry.begin(); it != entry.end(); it++) {
+            writeString(out, it->first);
+            writeString(out, it->second);
+        }
+        out << "end\n";
+        out.flush();
+        if (!out) {
+            unlink(tmp.str().c_str());
+            return;
+        }
+    }
+    if (rename(tmp.str().c_str(), path(key).c_str()) != 0)
+        unlink(tmp.str().c_str());
+    evict();
+}
+
+struct CacheFile {
+    string path;
+    time_t used;
+    size_t size;
+
+    bool operator<(const CacheFile &other) const { return used < other.used; }
+};
+
+/* Remove the least recently used entries until the directory fits in the
+   limit. Other processes may be removing the same files, so failures to
+   unlink are ignored. */
+void Cache::evict()
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    vector<CacheFile> files;
+    size_t total = 0;
+    time_t now = time(0);
+    const size_t suffix = strlen(ENTRY_SUFFIX);
+    for (struct dirent *de; (de = readdir(d)) != 0; ) {
+        string name(de->d_name);
+        CacheFile f;
+        struct stat st;
+        f.path = dir + "/" + name;
+        if (stat(f.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (name.compare(0, 4, "tmp.") == 0) {
+            if (now - st.st_mtime > STALE_SECONDS)
+                unlink(f.path.c_str());
+            continue;
+        }
+        if (name.size() <= suffix || name.compare(name.size() - suffix, suffix, ENTRY_SUFFIX) != 0)
+            continue;
+        f.used = st.st_mtime;
+        f.size = st.st_size;
+        total += f.size;
+        files.push_back(f);
+    }
+    closedir(d);
+
+    sort(files.begin(), files.end());
+    for (uint i = 0; i < files.size() && total > limit; i++) {
+        unlink(files[i].path.c_str());
+        total -= files[i].size;
+    }
+}
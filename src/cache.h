@@ -0,0 +1,37 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <map>
+#include <string>
+
+#include "net.h"
+
+/* On-disk cache of unfolding results. An entry is a set of named sections
+   stored in one file of the cache directory, named after a digest of its
+   key. Entries are written to a temporary file and renamed into place, so
+   other processes only ever see complete ones. Reading an entry touches
+   it, and the least recently used entries are removed when the directory
+   grows over its size limit. */
+class Cache {
+public:
+    typedef map<string, string> Entry;
+
+    Cache(const string &dir, size_t limit);
+
+    bool get(const string &key, Entry &entry);
+    void put(const string &key, const Entry &entry);
+
+private:
+    string dir;
+    size_t limit;
+
+    string path(const string &key) const;
+    void evict();
+};
+
+/* Digest of what the unfolding depends on: places with their names and
+   initial marking, transitions with their names and arcs, in id order.
+   Layout and other fields the reader drops are not part of it. */
+string netDigest(const Net *net);
+
+#endif
@@ -0,0 +1,378 @@
+#include "check.h"
+#include "trace.h"
+
+#include <pthread.h>
+
+/* Subtrees the search is cut into before the threads start. It does not
+   depend on the number of threads, so neither does the witness. */
+#define SPLIT_JOBS 256
+
+#define NO_JOB ((uint) -1)
+
+struct Checker::Work {
+    const Checker *checker;
+    vector<Job> *jobs;
+    pthread_mutex_t *lock;
+    uint *next;
+    volatile uint *best;
+    unsigned long visited;
+};
+
+static bool enabledAt(const BitVector &cut, const Event *e)
+{
+    for (list<Cond *>::const_iterator c = e->pre.begin(); c != e->pre.end(); c++)
+        if (!cut.test((*c)->id))
+            return false;
+    for (list<Cond *>::const_iterator c = e->read.begin(); c != e->read.end(); c++)
+        if (!cut.test((*c)->id))
+            return false;
+    return true;
+}
+
+/* Whether f can still be added to the configuration. */
+bool Checker::compatible(const Node &n, const Event *f) const
+{
+    return !f->conflict.intersects(n.events) && !n.conflict.intersects(f->past);
+}
+
+/* Whether some other event that can still fire would disable e, or read
+   one of its preconditions and so have to fire before it. */
+bool Checker::contested(const Node &n, const Event *e) const
+{
+    for (list<Cond *>::const_iterator c = e->pre.begin(); c != e->pre.end(); c++) {
+        for (list<Event *>::const_iterator f = (*c)->post.begin(); f != (*c)->post.end(); f++)
+            if (*f != e && compatible(n, *f))
+                return true;
+        for (list<Event *>::const_iterator f = (*c)->read.begin(); f != (*c)->read.end(); f++)
+            if (!n.events.test((*f)->id) && compatible(n, *f))
+                return true;
+    }
+    for (list<Cond *>::const_iterator c = e->read.begin(); c != e->read.end(); c++)
+        for (list<Event *>::const_iterator f = (*c)->post.begin(); f != (*c)->post.end(); f++)
+            if (compatible(n, *f))
+                return true;
+    return false;
+}
+
+bool Checker::consumesTarget(const Event *e) const
+{
+    for (list<Cond *>::const_iterator c = e->pre.begin(); c != e->pre.end(); c++)
+        if (target.test((*c)->origin->id))
+            return true;
+    return false;
+}
+
+/* The history e would have if it fired now: what precedes it through
+   causality and through the events of the configuration that read its
+   preconditions, or those of its predecessors. 0 if the prefix does not
+   have it. */
+const Hist *Checker::history(const Node &n, Event *e) const
+{
+    BitVector events;
+    vector<Event *> stack(1, e);
+    events.set(e->id);
+    while (!stack.empty()) {
+        Event *x = stack.back();
+        stack.pop_back();
+        vector<Event *> before;
+        for (list<Cond *>::iterator c = x->pre.begin(); c != x->pre.end(); c++) {
+            before.push_back((*c)->pre.front());
+            for (list<Event *>::iterator r = (*c)->read.begin(); r != (*c)->read.end(); r++)
+                if (n.events.test((*r)->id))
+                    before.push_back(*r);
+        }
+        for (list<Cond *>::iterator c = x->read.begin(); c != x->read.end(); c++)
+            before.push_back((*c)->pre.front());
+        for (uint i = 0; i < before.size(); i++)
+            if (!events.test(before[i]->id)) {
+                events.set(before[i]->id);
+                stack.push_back(before[i]);
+            }
+    }
+    for (list<Hist *>::const_iterator h = e->hist.begin(); h != e->hist.end(); h++)
+        if ((*h)->events == events)
+            return *h;
+    return 0;
+}
+
+void Checker::fire(Node &n, Event *e) const
+{
+    n.events.set(e->id);
+    n.conflict |= e->conflict;
+    for (list<Cond *>::iterator c = e->pre.begin(); c != e->pre.end(); c++)
+        n.cut.reset((*c)->id);
+    for (list<Cond *>::iterator c = e->post.begin(); c != e->post.end(); c++)
+        n.cut.set((*c)->id);
+    for (list<Cond *>::iterator c = e->read.begin(); c != e->read.end(); c++)
+        for (list<Event *>::iterator x = (*c)->post.begin(); x != (*c)->post.end(); x++)
+            n.excluded.reset((*x)->id);
+    n.fired.push_back(e);
+}
+
+/* Whether the marking of the cut enables no transition of the net. */
+bool Checker::dead(const Node &n) const
+{
+    BitVector marked;
+    for (int i = n.cut.next(0); i >= 0; i = n.cut.next(i + 1))
+        marked.set(unf->conditions[i]->origin->id);
+    for (set<Trans *>::const_iterator t = net->transitions.begin(); t != net->transitions.end(); t++) {
+        bool enabled = true;
+        for (list<Place *>::iterator p = (*t)->pre.begin(); enabled && p != (*t)->pre.end(); p++)
+            enabled = marked.test((*p)->id);
+        for (list<Place *>::iterator p = (*t)->read.begin(); enabled && p != (*t)->read.end(); p++)
+            enabled = marked.test((*p)->id);
+        if (enabled)
+            return false;
+    }
+    return true;
+}
+
+bool Checker::covered(const Node &n) const
+{
+    for (uint i = 0; i < targets.size(); i++) {
+        Place::Image &image = targets[i]->image;
+        Place::Image::iterator c = image.begin();
+        while (c != image.end() && !n.cut.test((*c)->id))
+            c++;
+        if (c == image.end())
+            return false;
+    }
+    return true;
+}
+
+/* Whether every target place still has a condition that is marked or can
+   be produced, and, with the co-relation, whether some choice of them is
+   pairwise concurrent. */
+bool Checker::coverable(const Node &n) const
+{
+    vector<vector<Cond *> > cand(targets.size());
+    for (uint i = 0; i < targets.size(); i++) {
+        Place::Image &image = targets[i]->image;
+        for (Place::Image::iterator c = image.begin(); c != image.end(); c++) {
+            Event *e = (*c)->pre.front();
+            if (n.cut.test((*c)->id) || (!n.events.test(e->id) && compatible(n, e)))
+                cand[i].push_back(*c);
+        }
+        if (cand[i].empty())
+            return false;
+    }
+    vector<Cond *> picked;
+    return !co || select(cand, 0, picked);
+}
+
+bool Checker::select(const vector<vector<Cond *> > &cand, uint i, vector<Cond *> &picked) const
+{
+    if (i == cand.size())
+        return true;
+    for (uint k = 0; k < cand[i].size(); k++) {
+        uint j = 0;
+        while (j < picked.size() && co->co(cand[i][k], picked[j]))
+            j++;
+        if (j < picked.size())
+            continue;
+        picked.push_back(cand[i][k]);
+        if (select(cand, i + 1, picked))
+            return true;
+        picked.pop_back();
+    }
+    return false;
+}
+
+/* Fire the events that need no choice until the node is a witness, cannot
+   lead to one, or has to branch on an event. Events that nothing competes
+   with fire at once: a deadlock has to contain them, and firing them keeps
+   the places covered. */
+Checker::Step Checker::step(Node &n, Event *&branch, unsigned long &visited) const
+{
+    bool deadlock = targets.empty();
+    for (;;) {
+        visited++;
+        if (!deadlock) {
+            if (covered(n))
+                return FOUND;
+            if (!coverable(n))
+                return DEAD;
+        }
+
+        vector<Event *> enabled;
+        BitVector listed;
+        for (int i = n.cut.next(0); i >= 0; i = n.cut.next(i + 1)) {
+            Cond *c = unf->conditions[i];
+            for (int pass = 0; pass < 2; pass++) {
+                list<Event *> &events = pass? c->read : c->post;
+                for (list<Event *>::iterator e = events.begin(); e != events.end(); e++)
+                    if (!listed.test((*e)->id)) {
+                        listed.set((*e)->id);
+                        if (!n.events.test((*e)->id) && enabledAt(n.cut, *e))
+                            enabled.push_back(*e);
+                    }
+            }
+        }
+        if (enabled.empty())
+            return deadlock && dead(n)? FOUND : DEAD;
+
+        branch = 0;
+        Event *forced = 0;
+        for (uint i = 0; i < enabled.size() && !forced; i++) {
+            Event *e = enabled[i];
+            bool free = !contested(n, e);
+            if (!free && branch)
+                continue;
+            bool blocked = n.excluded.test(e->id);
+            if (!blocked) {
+                const Hist *h = history(n, e);
+                blocked = h && h->cutoff;
+            }
+            if (blocked) {
+                /* It stays enabled, so the configuration is no deadlock. */
+                if (free && deadlock)
+                    return DEAD;
+            } else if (free && (deadlock || !consumesTarget(e)))
+                forced = e;
+            else if (!branch)
+                branch = e;
+        }
+        if (!forced)
+            return branch? BRANCH : DEAD;
+        fire(n, forced);
+    }
+}
+
+/* Depth first: fire the event, then search on without it until an event
+   reading one of its preconditions fires. */
+bool Checker::explore(Node &n, vector<Event *> &witness, unsigned long &visited,
+                      const volatile uint *best, uint job) const
+{
+    for (;;) {
+        /* Another thread found a witness that comes first. */
+        if (*best < job)
+            return false;
+        Event *e;
+        Step s = step(n, e, visited);
+        if (s == FOUND) {
+            witness = n.fired;
+            return true;
+        }
+        if (s == DEAD)
+            return false;
+        Node child = n;
+        fire(child, e);
+        if (explore(child, witness, visited, best, job))
+            return true;
+        n.excluded.set(e->id);
+    }
+}
+
+void *Checker::worker(void *arg)
+{
+    Work *w = (Work *) arg;
+    vector<Job> &jobs = *w->jobs;
+    for (;;) {
+        pthread_mutex_lock(w->lock);
+        uint i = (*w->next)++;
+        pthread_mutex_unlock(w->lock);
+        if (i >= jobs.size() || i > *w->best)
+            break;
+        if (jobs[i].found)
+            continue;
+        TRACE_SPAN("check job");
+        if (w->checker->explore(jobs[i].node, jobs[i].witness, w->visited, w->best, i)) {
+            pthread_mutex_lock(w->lock);
+            jobs[i].found = true;
+            if (i < *w->best)
+                *w->best = i;
+            pthread_mutex_unlock(w->lock);
+        }
+    }
+    return 0;
+}
+
+bool Checker::run(int threads, vector<Event *> &witness)
+{
+    unsigned long visited = 0;
+    list<Job> split(1);
+    Node &root = split.front().node;
+    root.events.set(unf->root->id);
+    for (list<Cond *>::iterator c = unf->root->post.begin(); c != unf->root->post.end(); c++)
+        root.cut.set((*c)->id);
+    split.front().found = false;
+
+    /* Replace every open subtree by its two children, in the order the
+       sequential search visits them, until there are enough. */
+    for (bool grown = true; grown && split.size() < SPLIT_JOBS; ) {
+        grown = false;
+        for (list<Job>::iterator j = split.begin(); j != split.end(); ) {
+            if (j->found) {
+                j++;
+                continue;
+            }
+            Event *e;
+            Step s = step(j->node, e, visited);
+            if (s == DEAD) {
+                j = split.erase(j);
+                continue;
+            }
+            if (s == FOUND) {
+                j->found = true;
+                j->witness = j->node.fired;
+            } else {
+                Job child = *j;
+                fire(child.node, e);
+                j->node.excluded.set(e->id);
+                split.insert(j, child);
+                grown = true;
+            }
+            j++;
+        }
+    }
+
+    vector<Job> jobs(split.begin(), split.end());
+    split.clear();
+    volatile uint best = NO_JOB;
+    for (uint i = 0; i < jobs.size() && best == NO_JOB; i++)
+        if (jobs[i].found)
+            best = i;
+
+    if (threads < 1) threads = 1;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    uint next = 0;
+    vector<pthread_t> tid(threads);
+    vector<Work> work(threads);
+    for (int k = 0; k < threads; k++) {
+        Work w = { this, &jobs, &lock, &next, &best, 0 };
+        work[k] = w;
+        if (pthread_create(&tid[k], 0, worker, &work[k])) {
+            cerr << "could not create thread\n"; exit(1);
+        }
+    }
+    for (int k = 0; k < threads; k++) {
+        pthread_join(tid[k], 0);
+        visited += work[k].visited;
+    }
+    nodes = visited;
+
+    if (best == NO_JOB)
+        return false;
+    witness = jobs[best].witness;
+    return true;
+}
+
+bool Checker::deadlock(int threads, vector<Event *> &witness)
+{
+    target = BitVector();
+    targets.clear();
+    co = 0;
+    return run(threads, witness);
+}
+
+bool Checker::cover(const BitVector &places, const CoRelation *co, int threads,
+                    vector<Event *> &witness)
+{
+    target = places;
+    targets.clear();
+    for (set<Place *>::const_iterator p = net->places.begin(); p != net->places.end(); p++)
+        if (places.test((*p)->id))
+            targets.push_back(*p);
+    this->co = co;
+    return run(threads, witness);
+}
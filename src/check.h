@@ -0,0 +1,78 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include "net.h"
+#include "corel.h"
+
+#include <vector>
+
+/* Searches a complete prefix for a configuration whose marking enables no
+   transition of the net (a deadlock), or marks a given set of places. The
+   configurations are built by firing events of the prefix; of the events
+   competing for a condition, the search branches on whether one fires now,
+   and the subtrees near the root are shared out among threads. An event is
+   only fired if its history in the configuration is no cutoff, since the
+   markings reached by the others are reached without them too. The first
+   witness in the order of the sequential search is returned, whatever the
+   number of threads. */
+class Checker {
+public:
+    Checker(const Net *net, const Unf *unf): net(net), unf(unf), co(0), nodes(0) {}
+
+    bool deadlock(int threads, vector<Event *> &witness);
+
+    /* co, when given, prunes the configurations that cannot mark the
+       places anymore. */
+    bool cover(const BitVector &places, const CoRelation *co, int threads,
+               vector<Event *> &witness);
+
+    /* Search nodes visited by the last search. */
+    unsigned long searched() const { return nodes; }
+
+private:
+    /* A configuration being built, and the events that may not fire until
+       an event reading one of their preconditions has fired. */
+    struct Node {
+        BitVector events;
+        BitVector conflict;  /* union of the conflict labels of events */
+        BitVector cut;       /* conditions marked */
+        BitVector excluded;
+        vector<Event *> fired;
+    };
+
+    /* A subtree of the search, given out to one thread. */
+    struct Job {
+        Node node;
+        bool found;
+        vector<Event *> witness;
+    };
+    struct Work;
+
+    enum Step { FOUND, DEAD, BRANCH };
+
+    const Net *net;
+    const Unf *unf;
+    BitVector target;           /* empty when looking for a deadlock */
+    vector<Place *> targets;
+    const CoRelation *co;
+    unsigned long nodes;
+
+    bool run(int threads, vector<Event *> &witness);
+    Step step(Node &n, Event *&branch, unsigned long &visited) const;
+    bool explore(Node &n, vector<Event *> &witness, unsigned long &visited,
+                 const volatile uint *best, uint job) const;
+    void fire(Node &n, Event *e) const;
+
+    bool compatible(const Node &n, const Event *f) const;
+    bool contested(const Node &n, const Event *e) const;
+    bool consumesTarget(const Event *e) const;
+    const Hist *history(const Node &n, Event *e) const;
+    bool dead(const Node &n) const;
+    bool covered(const Node &n) const;
+    bool coverable(const Node &n) const;
+    bool select(const vector<vector<Cond *> > &cand, uint i, vector<Cond *> &picked) const;
+
+    static void *worker(void *arg);
+};
+
+#endif
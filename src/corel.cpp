@@ -0,0 +1,113 @@
+#include "corel.h"
+#include "order.h"
+#include "trace.h"
+
+#include <pthread.h>
+#include <cstring>
+
+#define COREL_MAGIC "AUNFCO1"
+
+struct CoWork {
+    const Unf *unf;
+    vector<size_t> *row;
+    vector<BitVector::word> *bits;
+    uint first, step;
+};
+
+/* Two conditions are concurrent if some histories of their producers
+   together form a configuration that consumes neither of them. */
+static bool concurrent(const Unf *unf, AsymOrder &order, const Cond *a, const Cond *b)
+{
+    TRACE_SPAN("concurrent");
+    const list<Hist *> &ha = a->pre.front()->hist, &hb = b->pre.front()->hist;
+    for (list<Hist *>::const_iterator i = ha.begin(); i != ha.end(); i++)
+        for (list<Hist *>::const_iterator j = hb.begin(); j != hb.end(); j++) {
+            if ((*i)->conflict.intersects((*j)->events)
+                    || (*j)->conflict.intersects((*i)->events))
+                continue;
+            order.undo(0);
+            if (!order.add(*i) || !order.add(*j))
+                continue;
+            if (!unf->consumed(a, order.events()) && !unf->consumed(b, order.events()))
+                return true;
+        }
+    return false;
+}
+
+void *CoRelation::worker(void *arg)
+{
+    CoWork *w = (CoWork *) arg;
+    const vector<Cond *> &conds = w->unf->conditions;
+    AsymOrder order(w->unf);
+    for (uint i = w->first; i < conds.size(); i += w->step) {
+        TRACE_SPAN("co-relation row");
+        BitVector::word *r = &(*w->bits)[(*w->row)[i]];
+        for (uint j = 0; j < i; j++)
+            if (concurrent(w->unf, order, conds[i], conds[j]))
+                r[j / BitVector::WORD_BITS] |= (BitVector::word)1 << (j % BitVector::WORD_BITS);
+    }
+    return 0;
+}
+
+void CoRelation::build(const Unf *unf, int threads)
+{
+    TRACE_SPAN("co-relation");
+    n = unf->conditions.size();
+    row.resize(n + 1);
+    row[0] = 0;
+    for (uint i = 0; i < n; i++)
+        row[i + 1] = row[i] + (i + BitVector::WORD_BITS - 1) / BitVector::WORD_BITS;
+    bits.assign(row[n], 0);
+
+    if (threads < 1) threads = 1;
+    vector<pthread_t> tid(threads);
+    vector<CoWork> work(threads);
+    for (int k = 0; k < threads; k++) {
+        /* Rows get longer with i, so hand them out round robin. */
+        CoWork w = { unf, &row, &bits, (uint) k, (uint) threads };
+        work[k] = w;
+        if (pthread_create(&tid[k], 0, worker, &work[k])) {
+            cerr << "could not create thread\n"; exit(1);
+        }
+    }
+    for (int k = 0; k < threads; k++)
+        pthread_join(tid[k], 0);
+}
+
+bool CoRelation::co(const Cond *a, const Cond *b) const
+{
+    uint i = a->id, j = b->id;
+    if (i == j)
+        return false;
+    if (i < j) { uint t = i; i = j; j = t; }
+    return (bits[row[i] + j / BitVector::WORD_BITS] >> (j % BitVector::WORD_BITS)) & 1;
+}
+
+size_t CoRelation::memory() const
+{
+    return row.capacity() * sizeof(size_t) + bits.capacity() * sizeof(BitVector::word);
+}
+
+/* Layout: magic, number of conditions, then the rows one after the other. */
+void CoRelation::write(ostream &out) const
+{
+    out.write(COREL_MAGIC, sizeof(COREL_MAGIC));
+    out.write((const char *) &n, sizeof(n));
+    if (!bits.empty())
+        out.write((const char *) &bits[0], bits.size() * sizeof(BitVector::word));
+}
+
+bool CoRelation::read(istream &in)
+{
+    char magic[sizeof(COREL_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, COREL_MAGIC, sizeof(magic)))
+        return false;
+    if (!in.read((char *) &n, sizeof(n)))
+        return false;
+    row.resize(n + 1);
+    row[0] = 0;
+    for (uint i = 0; i < n; i++)
+        row[i + 1] = row[i] + (i + BitVector::WORD_BITS - 1) / BitVector::WORD_BITS;
+    bits.assign(row[n], 0);
+    return bits.empty() || in.read((char *) &bits[0], bits.size() * sizeof(BitVector::word));
+}
@@ -0,0 +1,32 @@
+#ifndef COREL_H
+#define COREL_H
+
+#include <ostream>
+#include <istream>
+
+#include "net.h"
+
+/* Concurrency relation on the conditions of a finished prefix, stored as a
+   lower triangular bit matrix: row i holds one bit for every condition with
+   a smaller id, and starts on a word boundary so that rows can be filled by
+   different threads. */
+class CoRelation {
+public:
+    CoRelation(): n(0) {}
+
+    void build(const Unf *unf, int threads);
+    bool co(const Cond *a, const Cond *b) const;
+    size_t memory() const;
+
+    void write(ostream &out) const;
+    bool read(istream &in);
+
+private:
+    uint n;
+    vector<size_t> row;
+    vector<BitVector::word> bits;
+
+    static void *worker(void *arg);
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "families.h"
+
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+/* Places and transitions numbered from 1, as read_pep_net does. */
+class NetBuilder {
+public:
+    Net *net;
+
+    NetBuilder(): net(new Net()) {}
+
+    Place *place(const string &name, uint index, bool marked) {
+        Place *p = new Place();
+        p->id = net->places.size() + 1;
+        p->name = numbered(name, index);
+        p->mark = marked;
+        net->places.insert(p);
+        return p;
+    }
+
+    Trans *trans(const string &name, uint index) {
+        Trans *t = new Trans();
+        t->id = net->transitions.size() + 1;
+        t->name = numbered(name, index);
+        net->transitions.insert(t);
+        return t;
+    }
+
+private:
+    static string numbered(const string &name, uint index) {
+        ostringstream s;
+        s << name << index;
+        return s.str();
+    }
+};
+
+static Net *readersWriters(uint n, uint writers)
+{
+    NetBuilder b;
+    Place *nowriter = b.place("nowriter", 0, true);
+    vector<Place *> idle(n);
+    for (uint i = 0; i < n; i++) {
+        idle[i] = b.place("ridle", i, true);
+        Place *reading = b.place("reading", i, false);
+        Trans *start = b.trans("rstart", i), *end = b.trans("rend", i);
+        b.net->createArc(idle[i], start);
+        b.net->createReadArc(start, nowriter);
+        b.net->createArc(start, reading);
+        b.net->createArc(reading, end);
+        b.net->createArc(end, idle[i]);
+    }
+    for (uint j = 0; j < writers; j++) {
+        Place *widle = b.place("widle", j, true), *writing = b.place("writing", j, false);
+        Trans *start = b.trans("wstart", j), *end = b.trans("wend", j);
+        b.net->createArc(widle, start);
+        b.net->createArc(nowriter, start);
+        for (uint i = 0; i < n; i++)
+            b.net->createReadArc(start, idle[i]);
+        b.net->createArc(start, writing);
+        b.net->createArc(writing, end);
+        b.net->createArc(end, widle);
+        b.net->createArc(end, nowriter);
+    }
+    return b.net;
+}
+
+static Net *philosophers(uint n)
+{
+    NetBuilder b;
+    vector<Place *> fork(n);
+    for (uint i = 0; i < n; i++)
+        fork[i] = b.place("fork", i, true);
+    for (uint i = 0; i < n; i++) {
+        Place *think = b.place("think", i, true), *left = b.place("left", i, false);
+        Place *eat = b.place("eat", i, false);
+        Trans *takeLeft = b.trans("takel", i), *takeRight = b.trans("taker", i);
+        Trans *release = b.trans("release", i);
+        b.net->createArc(think, takeLeft);
+        b.net->createArc(fork[i], takeLeft);
+        b.net->createArc(takeLeft, left);
+        b.net->createArc(left, takeRight);
+        b.net->createArc(fork[(i + 1) % n], takeRight);
+        b.net->createArc(takeRight, eat);
+        b.net->createArc(eat, release);
+        b.net->createArc(release, think);
+        b.net->createArc(release, fork[i]);
+        b.net->createArc(release, fork[(i + 1) % n]);
+    }
+    return b.net;
+}
+
+static Net *bufferChain(uint n)
+{
+    NetBuilder b;
+    vector<Place *> empty(n), full(n);
+    for (uint i = 0; i < n; i++) {
+        empty[i] = b.place("empty", i, true);
+        full[i] = b.place("full", i, false);
+    }
+    Trans *put = b.trans("put", 0), *get = b.trans("get", 0);
+    b.net->createArc(empty[0], put);
+    b.net->createArc(put, full[0]);
+    for (uint i = 0; i + 1 < n; i++) {
+        Trans *move = b.trans("move", i);
+        b.net->createArc(full[i], move);
+        b.net->createArc(empty[i + 1], move);
+        b.net->createArc(move, empty[i]);
+        b.net->createArc(move, full[i + 1]);
+    }
+    b.net->createArc(full[n - 1], get);
+    b.net->createArc(get, empty[n - 1]);
+    return b.net;
+}
+
+/* A local state drawn from r, the initial one half of the time, so that
+   synchronizations and reads are not all dead. */
+static uint local(unsigned long long r, uint k)
+{
+    return (r >> 33) % 2? 0 : (r >> 34) % k;
+}
+
+/* Each transition moves one component, or two at once, between local
+   states and reads the states of other components. A component always has
+   exactly one marked place, so the net is safe. The expected share of
+   read arcs among all arcs is opt.read. */
+static Net *randomNet(uint n, const FamilyOptions &opt)
+{
+    NetBuilder b;
+    unsigned long long r = opt.seed;
+    uint k = opt.states < 2? 2 : opt.states;
+    vector<vector<Place *> > state(n, vector<Place *>(k));
+    for (uint i = 0; i < n; i++)
+        for (uint s = 0; s < k; s++)
+            state[i][s] = b.place(s? "s" : "init", i * k + s, s == 0);
+
+    for (uint i = 0; i < n; i++)
+        for (uint m = 0; m < 2 * k; m++) {
+            Trans *t = b.trans("t", i * 2 * k + m);
+            r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint j = n > 1 && (r >> 40) % 2? (i + 1 + (r >> 20) % (n - 1)) % n : i;
+            uint moved[] = { i, j }, arcs = 0;
+            for (uint c = 0; c < (j != i? 2u : 1u); c++) {
+                r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+                uint from = c? local(r, k) : m % k, to = (from + 1 + (r >> 45) % (k - 1)) % k;
+                b.net->createArc(state[moved[c]][from], t);
+                b.net->createArc(t, state[moved[c]][to]);
+                arcs += 2;
+            }
+            /* reads / (arcs + reads) is opt.read on average. */
+            double want = opt.read < 1? opt.read * arcs / (1 - opt.read) : n;
+            r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+            uint reads = (uint) want;
+            if (((r >> 11) & 0xffff) / 65536.0 < want - reads)
+                reads++;
+            vector<bool> used(n, false);
+            used[i] = used[j] = true;
+            uint left = n - (j != i? 2 : 1);
+            for (; reads && left; reads--, left--) {
+                r = r * 6364136223846793005ULL + 1442695040888963407ULL;
+                uint other = (r >> 33) % n;
+                while (used[other])
+                    other = (other + 1) % n;
+                used[other] = true;
+                b.net->createReadArc(t, state[other][local(r >> 20, k)]);
+            }
+        }
+    return b.net;
+}
+
+Net *generateNet(const char *family, uint n, const FamilyOptions &opt)
+{
+    if (n == 0)
+        return 0;
+    if (strcmp(family, "rw") == 0)
+        return readersWriters(n, opt.writers);
+    /* A single philosopher would take the same fork twice. */
+    if (strcmp(family, "dph") == 0)
+        return n < 2? 0 : philosophers(n);
+    if (strcmp(family, "buf") == 0)
+        return bufferChain(n);
+    if (strcmp(family, "random") == 0)
+        return randomNet(n, opt);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef FAMILIES_H
+#define FAMILIES_H
+
+#include "net.h"
+
+/* Parameters of the generated nets besides their size. */
+struct FamilyOptions {
+    uint writers;       /* rw: number of writers */
+    uint states;        /* random: local states of each component */
+    double read;        /* random: share of the arcs that are read arcs */
+    unsigned long long seed;
+
+    FamilyOptions(): writers(1), states(4), read(0.3), seed(1) {}
+};
+
+/* Safe nets of scalable size, for stress and scaling tests:
+     rw      n readers and some writers; readers test with a read arc that
+             no writer is writing, a writer tests that every reader is idle
+     dph     n dining philosophers taking the left fork first, n >= 2
+     buf     a chain of n one-place buffers
+     random  n state machines of a few states each, moving one or two at a
+             time and reading the states of others
+   Returns 0 if the family is unknown or n is too small for it. */
+Net *generateNet(const char *family, uint n, const FamilyOptions &opt);
+
+#endif
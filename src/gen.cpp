@@ -0,0 +1,93 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+
+#include "families.h"
+#include "readpep.h"
+#include "output.h"
+
+using namespace std;
+
+void usage() {
+    cerr <<
+"Usage: aunf-gen [parameters] family n\n\n"
+"Families:\n"
+"        rw           n readers and some writers, with read arcs\n"
+"        dph          n dining philosophers, n >= 2\n"
+"        buf          a chain of n one-place buffers\n"
+"        random       n communicating state machines with read arcs\n\n"
+"Parameters:\n"
+"        -o file_name Output to file, and check that it reads back\n"
+"        -writers n   Writers of rw (default 1)\n"
+"        -states n    Local states of each machine of random (default 4)\n"
+"        -read r      Share of read arcs in random, from 0 to 1 (default 0.3)\n"
+"        -seed n      Seed of random (default 1)\n";
+}
+
+static char *value(int argc, char **argv, int &i, const char *what) {
+    i++;
+    if (i >= argc) {
+        cerr << what << " not specified!\n";
+        exit(1);
+    }
+    return argv[i];
+}
+
+int main(int argc, char **argv) {
+    FamilyOptions opt;
+    char *output_file = 0;
+    char *family = 0;
+    int n = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0)
+            output_file = value(argc, argv, i, "output file");
+        else if (strcmp(argv[i], "-writers") == 0)
+            opt.writers = atoi(value(argc, argv, i, "number of writers"));
+        else if (strcmp(argv[i], "-states") == 0)
+            opt.states = atoi(value(argc, argv, i, "number of states"));
+        else if (strcmp(argv[i], "-read") == 0)
+            opt.read = atof(value(argc, argv, i, "share of read arcs"));
+        else if (strcmp(argv[i], "-seed") == 0)
+            opt.seed = strtoull(value(argc, argv, i, "seed"), 0, 10);
+        else if (argv[i][0] == '-') {
+            cerr << "option not recognized!\n";
+            exit(1);
+        } else if (!family)
+            family = argv[i];
+        else
+            n = atoi(argv[i]);
+    }
+    if (!family || n < 0) {
+        usage();
+        return 1;
+    }
+    if (opt.read < 0 || opt.read > 1) {
+        cerr << "share of read arcs must be between 0 and 1!\n";
+        exit(1);
+    }
+
+    Net *net = generateNet(family, n, opt);
+    if (!net) {
+        cerr << "unknown family or size!\n";
+        exit(1);
+    }
+    if (!output_file) {
+        writeLL(cout, net);
+        return 0;
+    }
+    {
+        ofstream out(output_file);
+        writeLL(out, net);
+    }
+    Net *back = read_pep_net(output_file);
+    if (back->places.size() != net->places.size()
+            || back->transitions.size() != net->transitions.size()) {
+        cerr << output_file << " does not read back!\n";
+        exit(1);
+    }
+    cerr << output_file << ": " << net->places.size() << " places and "
+         << net->transitions.size() << " transitions" << endl;
+    return 0;
+}
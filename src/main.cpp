@@ -1,11 +1,20 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <cstring>
 #include <string>
 #include <vector>
 
+#include <unistd.h>
+
 #include "readpep.h"
 #include "unf.h"
+#include "corel.h"
+#include "check.h"
+#include "progress.h"
+#include "output.h"
+#include "cache.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -16,17 +25,83 @@ void usage() {
 "        -dot         Dot output (default)\n"
 "        -ll          LLnet output\n"
 "        -asp         Answer Set Programming output\n"
+"        -mci         Binary prefix output in the format of Mole and Punf, with\n"
+"                     read arcs and histories added at the end\n"
 "        -convert     No net unfolding, just output the original net\n"
+"                     (sliced to the places given with -reach)\n"
 "        -histinf     Include history information\n"
 "                     (only applies to ll nets with applied unfolding)\n"
-"        -o file_name Output to file\n";
+"        -o file_name Output to file\n"
+"        -co file_name Compute the concurrency relation on conditions\n"
+"                     and save it to file\n"
+"        -threads n   Number of threads for parallel work, reading the net\n"
+"                     included (default: number of processors)\n"
+"        -workers n   Unfold with n worker processes searching for extensions\n"
+"                     while this one commits them; the prefix is the same\n"
+"                     (Linux, not with -resume)\n"
+"        -stats       Print statistics about the unfolding\n"
+"        -progress n  Print the size of the prefix, the length of the queue,\n"
+"                     the rate of new events and the memory used every n\n"
+"                     seconds while unfolding\n"
+"        -stats-file file_name Keep a JSON snapshot of the same numbers in\n"
+"                     file, rewritten every n seconds of -progress (default 1)\n"
+"        -timeout n   Stop unfolding after n seconds, and output the prefix\n"
+"                     built so far\n"
+"        -reach P1,P2,... Stop as soon as the places P1,P2,... can be marked\n"
+"                     together, and print a firing sequence marking them;\n"
+"                     the parts of the net that cannot affect them are\n"
+"                     removed first\n"
+"        -deadlock    Search the prefix for a reachable marking that enables no\n"
+"                     transition, and print a firing sequence reaching it\n"
+"        -cover P1,P2,... Search the prefix for a reachable marking of the places\n"
+"                     P1,P2,..., and print a firing sequence reaching it\n"
+"        -directed    With -reach, extend first what seems closer to the places\n"
+"        -symmetry    Detect symmetries of the net and cut off histories whose\n"
+"                     markings are symmetric to those of smaller ones; of\n"
+"                     histories of the same size, the one with fewer events\n"
+"                     of the first orbit of transitions where they differ\n"
+"                     is smaller\n"
+"        -save file_name Save a snapshot of the prefix to file\n"
+"        -resume old_net snapshot Unfold again after editing old_net, keeping\n"
+"                     the part of its saved prefix that the edits leave alone\n"
+"        -cache dir   Keep results in dir and reuse them when the same net is\n"
+"                     unfolded again with the same options (not with -resume)\n"
+"        -cache-size n Limit the cache to n megabytes (default: 256), dropping\n"
+"                     the least recently used results first\n";
 }
 
+#define DEFAULT_CACHE_MB 256
+
 #define OUTPUT_FORMAT_DOT   0
 #define OUTPUT_FORMAT_LLNET 1
 #define OUTPUT_FORMAT_ASP   2
+#define OUTPUT_FORMAT_MCI   3
+
+/* Ids of the places named in a comma separated list. */
+static BitVector placeSet(Net *net, const char *names) {
+    BitVector target;
+    string list(names);
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos)
+            end = list.size();
+        string name = list.substr(start, end - start);
+        set<Place *>::iterator p = net->places.begin();
+        while (p != net->places.end() && (*p)->name != name)
+            p++;
+        if (p == net->places.end()) {
+            cerr << "place " << name << " not found!\n";
+            exit(1);
+        }
+        target.set((*p)->id);
+        start = end + 1;
+    }
+    return target;
+}
 
 template <class T> void output(char *output_file, T *net, int format) {
+    TRACE_SPAN("output");
     ostream *out = output_file == 0? &cout : new ofstream(output_file);
     if (format == OUTPUT_FORMAT_DOT) {
         writeDot(*out, net);
@@ -35,6 +110,8 @@ template <class T> void output(char *output_file, T *net, int format) {
     } else if (format == OUTPUT_FORMAT_ASP) {
         writeAsp(*out, net);
     }
+    if (out != &cout)
+        delete out;
 }
 
 int main(int argc, char** argv) {
@@ -47,6 +124,23 @@ int main(int argc, char** argv) {
       int output_format = OUTPUT_FORMAT_DOT;
       bool convert = false;
       bool histinf = false;
+      bool stats = false;
+      uint progress = 0;
+      char *stats_file = 0;
+      uint timeout = 0;
+      char *co_file = 0;
+      char *reach = 0;
+      bool deadlock = false;
+      char *cover = 0;
+      bool directed = false;
+      bool symmetry = false;
+      char *save_file = 0;
+      char *old_file = 0;
+      char *snapshot_file = 0;
+      char *cache_dir = 0;
+      size_t cache_size = DEFAULT_CACHE_MB;
+      int threads = sysconf(_SC_NPROCESSORS_ONLN);
+      uint workers = 0;
 
       for (int i = 1; i < argc; i++) {
           if (strcmp(argv[i], "-dot") == 0)
@@ -55,10 +149,129 @@ int main(int argc, char** argv) {
               output_format = OUTPUT_FORMAT_LLNET;
           else if (strcmp(argv[i], "-asp") == 0)
               output_format = OUTPUT_FORMAT_ASP;
+          else if (strcmp(argv[i], "-mci") == 0)
+              output_format = OUTPUT_FORMAT_MCI;
           else if (strcmp(argv[i], "-convert") == 0)
               convert = true;
           else if (strcmp(argv[i], "-histinf") == 0)
               histinf = true;
+          else if (strcmp(argv[i], "-stats") == 0)
+              stats = true;
+          else if (strcmp(argv[i], "-progress") == 0) {
+              i++;
+              if (i < argc && atoi(argv[i]) > 0)
+                  progress = atoi(argv[i]);
+              else {
+                  cerr << "progress interval not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-stats-file") == 0) {
+              i++;
+              if (i < argc)
+                  stats_file = argv[i];
+              else {
+                  cerr << "stats file not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-timeout") == 0) {
+              i++;
+              if (i < argc && atoi(argv[i]) > 0)
+                  timeout = atoi(argv[i]);
+              else {
+                  cerr << "time limit not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-co") == 0) {
+              i++;
+              if (i < argc)
+                  co_file = argv[i];
+              else {
+                  cerr << "co-relation file not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-deadlock") == 0)
+              deadlock = true;
+          else if (strcmp(argv[i], "-cover") == 0) {
+              i++;
+              if (i < argc)
+                  cover = argv[i];
+              else {
+                  cerr << "places to cover not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-directed") == 0)
+              directed = true;
+          else if (strcmp(argv[i], "-symmetry") == 0)
+              symmetry = true;
+          else if (strcmp(argv[i], "-reach") == 0) {
+              i++;
+              if (i < argc)
+                  reach = argv[i];
+              else {
+                  cerr << "target places not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-save") == 0) {
+              i++;
+              if (i < argc)
+                  save_file = argv[i];
+              else {
+                  cerr << "snapshot file not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-resume") == 0) {
+              i += 2;
+              if (i < argc) {
+                  old_file = argv[i - 1];
+                  snapshot_file = argv[i];
+              } else {
+                  cerr << "old net and snapshot file not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-cache") == 0) {
+              i++;
+              if (i < argc)
+                  cache_dir = argv[i];
+              else {
+                  cerr << "cache directory not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-cache-size") == 0) {
+              i++;
+              if (i < argc && atoi(argv[i]) > 0)
+                  cache_size = atoi(argv[i]);
+              else {
+                  cerr << "cache size not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-threads") == 0) {
+              i++;
+              if (i < argc && atoi(argv[i]) > 0)
+                  threads = atoi(argv[i]);
+              else {
+                  cerr << "number of threads not specified!\n";
+                  exit(1);
+              }
+          }
+          else if (strcmp(argv[i], "-workers") == 0) {
+              i++;
+              if (i < argc && atoi(argv[i]) > 0)
+                  workers = atoi(argv[i]);
+              else {
+                  cerr << "number of workers not specified!\n";
+                  exit(1);
+              }
+          }
           else if (strcmp(argv[i], "-o") == 0) {
               i++;
               if (i < argc)
@@ -78,15 +291,207 @@ int main(int argc, char** argv) {
           cerr << "input file not specified!\n";
           exit(1);
       }
-      Net *net = read_pep_net(input_file);
+      if (convert && output_format == OUTPUT_FORMAT_MCI) {
+          cerr << "mci output needs an unfolding!\n";
+          exit(1);
+      }
+      if (reach && (deadlock || cover)) {
+          cerr << "-deadlock and -cover need a complete prefix, not -reach!\n";
+          exit(1);
+      }
+      Net *net = threads > 1? read_pep_net_parallel(input_file, threads)
+                            : read_pep_net(input_file);
       cerr << "Read " << input_file << ": " << net->places.size() << " places and "
            << net->transitions.size() << " transitions parsed" << endl;
+      /* The net as read and every option that changes the result. */
+      string key;
+      if (cache_dir) {
+          ostringstream k;
+          k << netDigest(net) << " reach=" << (reach? reach : "")
+            << " directed=" << directed << " symmetry=" << symmetry
+            << " deadlock=" << deadlock << " cover=" << (cover? cover : "")
+            << " save=" << (save_file != 0) << " co=" << (co_file != 0)
+            << " mci=" << (output_format == OUTPUT_FORMAT_MCI);
+          key = k.str();
+      }
+      BitVector target, covered;
+      if (cover)
+          covered = placeSet(net, cover);
+      if (reach) {
+          uint places = net->places.size(), transitions = net->transitions.size();
+          target = placeSet(net, reach);
+          net->slice(target);
+          if (stats)
+              cerr << "Sliced net: " << net->places.size() << " of " << places
+                   << " places, " << net->transitions.size() << " of "
+                   << transitions << " transitions kept" << endl;
+      }
       if (!convert) {
-        Unfolder *unf = new Unfolder();
-        unf->net = net;
+        /* What the run prints and writes, kept together so that it can be
+           stored in the cache and replayed from it. */
+        Cache::Entry result;
+        Cache *cache = 0;
+        if (cache_dir && !snapshot_file)
+            cache = new Cache(cache_dir, cache_size << 20);
+        if (cache && cache->get(key, result)) {
+            if (stats)
+                cerr << "Cache hit" << endl;
+        } else {
+            ostringstream out, log;
+            Unfolder *unf = new Unfolder();
+            unf->net = net;
+            unf->target = target;
+            unf->directed = directed;
+            unf->memstats = stats;
+            unf->workers = workers;
+            if (symmetry) {
+                /* Target places must stay where they are. */
+                unf->symmetry = new Symmetry();
+                unf->symmetry->find(net, cover? covered : target);
+                log << "Symmetry generators: " << unf->symmetry->generators() << endl;
+            }
+            Monitor *monitor = 0;
+            if (progress || stats_file || timeout) {
+                monitor = new Monitor(unf);
+                monitor->interval = progress;
+                monitor->statsFile = stats_file;
+                monitor->limit = timeout;
+                monitor->start();
+            }
+            if (snapshot_file) {
+                Net *old = threads > 1? read_pep_net_parallel(old_file, threads)
+                                      : read_pep_net(old_file);
+                /* The snapshot was taken on the sliced old net. */
+                if (reach)
+                    old->slice(placeSet(old, reach));
+                ifstream in(snapshot_file);
+                if (!in) {
+                    cerr << "could not open snapshot file\n";
+                    exit(1);
+                }
+                unf->resume(old, in);
+            } else
+                unf->unfold();
+            if (monitor)
+                monitor->stop();
+            /* Searches on a partial prefix still find real witnesses, but
+               finding none proves nothing. */
+            bool partial = unf->interrupted();
+            if (partial) {
+                cerr << "Time limit reached, the prefix is incomplete" << endl;
+                log << "Incomplete prefix: stopped after " << timeout << " s" << endl;
+            }
 
-      } else {
+            if (save_file) {
+                ostringstream snap;
+                unf->save(snap);
+                result["snapshot"] = snap.str();
+            }
 
+            /* The unfolder only sees the markings of single histories, but
+               several target places may be marked by concurrent ones
+               only. A complete prefix without a witness is therefore
+               searched as for -cover. */
+            bool search = reach && !unf->witness && !partial;
+            CoRelation *co = 0;
+            if (co_file || cover || search) {
+                co = new CoRelation();
+                co->build(unf->unf, threads);
+            }
+
+            if (reach) {
+                if (unf->witness) {
+                    const vector<uint> &seq = unf->witness->order;
+                    out << "Reachable:";
+                    for (uint i = 1; i < seq.size(); i++)
+                        out << " " << unf->unf->events[seq[i]]->name;
+                    out << endl;
+                } else if (search) {
+                    Checker check(net, unf->unf);
+                    vector<Event *> seq;
+                    if (check.cover(target, co, threads, seq)) {
+                        out << "Reachable:";
+                        for (uint i = 0; i < seq.size(); i++)
+                            out << " " << seq[i]->name;
+                        out << endl;
+                    } else
+                        out << "Not reachable" << endl;
+                    log << "Reach search nodes: " << check.searched() << endl;
+                } else
+                    out << "Not reachable within the time limit" << endl;
+            }
+            if (co_file) {
+                ostringstream rel(ios::binary);
+                co->write(rel);
+                result["co"] = rel.str();
+            }
+
+            if (deadlock || cover) {
+                Checker check(net, unf->unf);
+                vector<Event *> seq;
+                if (deadlock) {
+                    if (check.deadlock(threads, seq)) {
+                        out << "Deadlock:";
+                        for (uint i = 0; i < seq.size(); i++)
+                            out << " " << seq[i]->name;
+                        out << endl;
+                    } else
+                        out << (partial? "No deadlock found within the time limit"
+                                       : "No deadlock") << endl;
+                    log << "Deadlock search nodes: " << check.searched() << endl;
+                }
+                if (cover) {
+                    if (check.cover(covered, co, threads, seq)) {
+                        out << "Coverable:";
+                        for (uint i = 0; i < seq.size(); i++)
+                            out << " " << seq[i]->name;
+                        out << endl;
+                    } else
+                        out << (partial? "Not coverable within the time limit"
+                                       : "Not coverable") << endl;
+                    log << "Cover search nodes: " << check.searched() << endl;
+                }
+            }
+
+            log << "Events: " << unf->unf->events.size() - 1 << endl
+                << "Conditions: " << unf->unf->conditions.size() << endl
+                << "Histories: " << unf->histories << endl
+                << "Cutoffs: " << unf->cutoffs << endl
+                << "Enriched conditions: " << unf->ecs << endl;
+            if (co)
+                log << "Co-relation index: " << co->memory() << " bytes" << endl;
+            unf->memoryReport(log);
+            if (output_format == OUTPUT_FORMAT_MCI) {
+                ostringstream mci(ios::binary);
+                writeMci(mci, unf);
+                result["mci"] = mci.str();
+            }
+            result["out"] = out.str();
+            result["stats"] = log.str();
+            if (cache && !partial)
+                cache->put(key, result);
+        }
+
+        TRACE_SPAN("output");
+        cout << result["out"];
+        if (stats)
+            cerr << result["stats"];
+        if (save_file) {
+            ofstream out(save_file, ios::binary);
+            out << result["snapshot"];
+        }
+        if (co_file) {
+            ofstream out(co_file, ios::binary);
+            out << result["co"];
+        }
+        if (output_format == OUTPUT_FORMAT_MCI) {
+            ostream *out = output_file == 0? &cout : new ofstream(output_file, ios::binary);
+            *out << result["mci"];
+            if (out != &cout)
+                delete out;
+        }
+      } else {
+          output(output_file, net, output_format);
       }
   }
   return 0;
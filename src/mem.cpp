@@ -0,0 +1,25 @@
+#include "mem.h"
+
+#include <cstring>
+
+MemCounter memCounters[MEM_COUNTED];
+MemCounter memTotal;
+
+const char *memNames[MEM_COUNTED] = {
+    "co-sets", "enriched co-sets", "images", "histories", "events", "queue"
+};
+
+void memReset()
+{
+    memset(memCounters, 0, sizeof(memCounters));
+    memset(&memTotal, 0, sizeof(memTotal));
+}
+
+void memReport(ostream &out, const char **names, const size_t *bytes, int n)
+{
+    for (int c = 0; c < MEM_COUNTED; c++)
+        out << "Memory, " << memNames[c] << ": " << memCounters[c].live
+            << " bytes (peak " << memCounters[c].peak << ")" << endl;
+    for (int i = 0; i < n; i++)
+        out << "Memory, " << names[i] << ": " << bytes[i] << " bytes" << endl;
+}
@@ -0,0 +1,74 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+
+using namespace std;
+
+/* Memory accounting per kind of structure, for -stats. Containers count
+   their allocations through CountingAllocator; other structures are added
+   when they are created, or measured when the report is made. */
+enum MemCategory {
+    MEM_COSETS,         /* co-sets of histories and possible extensions */
+    MEM_CO_PRIVATE,     /* EnrichedCond::co_private */
+    MEM_IMAGES,         /* Place::image and Trans::image lists */
+    MEM_HISTORIES,      /* Hist objects with their bit vectors and orders */
+    MEM_EVENTS,         /* events and conditions */
+    MEM_QUEUE,          /* possible extensions waiting in the queue */
+    MEM_COUNTED
+};
+
+struct MemCounter {
+    size_t live, peak;
+};
+
+extern MemCounter memCounters[MEM_COUNTED];
+extern MemCounter memTotal;     /* all kinds together */
+extern const char *memNames[MEM_COUNTED];
+
+/* The unfolder runs on one thread, so the counters are plain. */
+inline void memAdd(int c, size_t n)
+{
+    MemCounter &m = memCounters[c];
+    m.live += n;
+    if (m.live > m.peak)
+        m.peak = m.live;
+    memTotal.live += n;
+    if (memTotal.live > memTotal.peak)
+        memTotal.peak = memTotal.live;
+}
+
+inline void memSub(int c, size_t n)
+{
+    memCounters[c].live -= n;
+    memTotal.live -= n;
+}
+
+/* Zero the counters, to measure several unfoldings one after the other. */
+void memReset();
+
+template <class T, int C> class CountingAllocator : public allocator<T> {
+public:
+    template <class U> struct rebind { typedef CountingAllocator<U, C> other; };
+
+    CountingAllocator() {}
+    CountingAllocator(const CountingAllocator &) : allocator<T>() {}
+    template <class U> CountingAllocator(const CountingAllocator<U, C> &) {}
+
+    T *allocate(size_t n) {
+        memAdd(C, n * sizeof(T));
+        return allocator<T>::allocate(n);
+    }
+    void deallocate(T *p, size_t n) {
+        memSub(C, n * sizeof(T));
+        allocator<T>::deallocate(p, n);
+    }
+};
+
+/* Live and peak bytes of every counted category, then the bytes of the
+   measured ones, which only grow. */
+void memReport(ostream &out, const char **names, const size_t *bytes, int n);
+
+#endif
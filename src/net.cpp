@@ -1,6 +1,10 @@
 #include "net.h"
+#include "trace.h"
+
+#include <map>
 
 Coset *EnrichedCond::co() {
+    TRACE_SPAN("co-set");
     Coset *co_result = new Coset();
     co_result->insert(this->co_private.begin(), this->co_private.end());
     for (Coset_iter it = h->concurrent.begin(); it != h->concurrent.end(); it++) {
@@ -10,6 +14,13 @@ Coset *EnrichedCond::co() {
     return co_result;
 }
 
+Net::~Net() {
+    for (set<Place *>::iterator p = places.begin(); p != places.end(); p++)
+        delete *p;
+    for (set<Trans *>::iterator t = transitions.begin(); t != transitions.end(); t++)
+        delete *t;
+}
+
 void Net::createArc(Place *p, Trans *t) {
     p->post.push_back(t);
     t->pre.push_back(p);
@@ -24,3 +35,165 @@ void Net::createReadArc(Trans *t, Place *p) {
     t->read.push_back(p);
     p->read.push_back(t);
 }
+
+/* Keep only the places and transitions that can influence the marking of
+   the target places (ids), and remove everything else. A place is kept if
+   it is a target, or a pre- or context place of a kept transition; a
+   transition is kept if it puts a token on a kept place or takes one from
+   it. Reading a place does not change its marking, so readers are not
+   pulled in through the places they read. The other transitions touch no
+   kept place, so the markings reachable on kept places stay the same. */
+void Net::slice(const BitVector &target) {
+    BitVector keepP, keepT;
+    list<Place *> todo;
+    for (set<Place *>::iterator p = places.begin(); p != places.end(); p++)
+        if (target.test((*p)->id)) {
+            keepP.set((*p)->id);
+            todo.push_back(*p);
+        }
+
+    while (!todo.empty()) {
+        Place *p = todo.front();
+        todo.pop_front();
+        list<Trans *> change(p->pre);
+        change.insert(change.end(), p->post.begin(), p->post.end());
+        for (list<Trans *>::iterator t = change.begin(); t != change.end(); t++) {
+            if (keepT.test((*t)->id))
+                continue;
+            keepT.set((*t)->id);
+            list<Place *> need((*t)->pre);
+            need.insert(need.end(), (*t)->read.begin(), (*t)->read.end());
+            for (list<Place *>::iterator q = need.begin(); q != need.end(); q++)
+                if (!keepP.test((*q)->id)) {
+                    keepP.set((*q)->id);
+                    todo.push_back(*q);
+                }
+        }
+    }
+
+    for (set<Trans *>::iterator t = transitions.begin(); t != transitions.end(); ) {
+        if (keepT.test((*t)->id)) {
+            for (list<Place *>::iterator q = (*t)->post.begin(); q != (*t)->post.end(); )
+                if (keepP.test((*q)->id)) q++; else q = (*t)->post.erase(q);
+            t++;
+        } else {
+            delete *t;
+            transitions.erase(t++);
+        }
+    }
+    for (set<Place *>::iterator p = places.begin(); p != places.end(); ) {
+        if (keepP.test((*p)->id)) {
+            list<Trans *> *arcs[] = { &(*p)->pre, &(*p)->post, &(*p)->read };
+            for (uint i = 0; i < 3; i++)
+                for (list<Trans *>::iterator t = arcs[i]->begin(); t != arcs[i]->end(); )
+                    if (keepT.test((*t)->id)) t++; else t = arcs[i]->erase(t);
+            p++;
+        } else {
+            delete *p;
+            places.erase(p++);
+        }
+    }
+}
+
+Unf::~Unf() {
+    for (uint i = 0; i < conditions.size(); i++) {
+        Cond *c = conditions[i];
+        for (list<EnrichedCond *>::iterator ec = c->ecs.begin(); ec != c->ecs.end(); ec++)
+            delete *ec;
+        delete c;
+    }
+    for (uint i = 0; i < events.size(); i++) {
+        Event *e = events[i];
+        for (list<Hist *>::iterator h = e->hist.begin(); h != e->hist.end(); h++)
+            delete *h;
+        delete e;
+    }
+}
+
+/* Compute the labels of e, which must already be linked to its pre- and
+   context conditions. */
+void Unf::label(Event *e) {
+    e->past.set(e->id);
+    for (list<Cond *>::iterator c = e->pre.begin(); c != e->pre.end(); c++) {
+        e->past |= (*c)->pre.front()->past;
+        e->conflict |= (*c)->pre.front()->conflict;
+        for (list<Event *>::iterator d = (*c)->post.begin(); d != (*c)->post.end(); d++)
+            if (*d != e) e->conflict.set((*d)->id);
+    }
+    for (list<Cond *>::iterator c = e->read.begin(); c != e->read.end(); c++) {
+        e->past |= (*c)->pre.front()->past;
+        e->conflict |= (*c)->pre.front()->conflict;
+    }
+}
+
+/* Whether a is in the causal past of b (or is b). */
+bool Unf::causes(const Event *a, const Event *b) const {
+    return b->past.test(a->id);
+}
+
+/* Whether the causal pasts of a and b contain two events competing for
+   the same condition. Of two such events, the older one is in the conflict
+   label of the younger one, so one of the two tests below finds it. */
+bool Unf::inConflict(const Event *a, const Event *b) const {
+    return a->conflict.intersects(b->past) || b->conflict.intersects(a->past);
+}
+
+/* Whether some event of the set consumes c. */
+bool Unf::consumed(const Cond *c, const BitVector &events) const {
+    for (list<Event *>::const_iterator it = c->post.begin(); it != c->post.end(); it++)
+        if (events.test((*it)->id))
+            return true;
+    return false;
+}
+
+/* Order a causally closed set of events so that every event comes after its
+   causes and after the events reading one of its preconditions (asymmetric
+   conflict). Returns false if no such order exists. */
+bool Unf::sequence(const BitVector &events, list<Event *> *seq) const {
+    map<Event *, int> indeg;
+    list<Event *> ready;
+    uint n = 0;
+
+    for (int i = events.next(0); i >= 0; i = events.next(i + 1)) {
+        Event *e = this->events[i];
+        indeg[e];
+        n++;
+        for (list<Cond *>::iterator c = e->post.begin(); c != e->post.end(); c++) {
+            for (list<Event *>::iterator d = (*c)->post.begin(); d != (*c)->post.end(); d++)
+                if (events.test((*d)->id)) indeg[*d]++;
+            for (list<Event *>::iterator d = (*c)->read.begin(); d != (*c)->read.end(); d++)
+                if (events.test((*d)->id)) indeg[*d]++;
+        }
+        for (list<Cond *>::iterator c = e->read.begin(); c != e->read.end(); c++)
+            for (list<Event *>::iterator d = (*c)->post.begin(); d != (*c)->post.end(); d++)
+                if (events.test((*d)->id)) indeg[*d]++;
+    }
+    for (map<Event *, int>::iterator it = indeg.begin(); it != indeg.end(); it++)
+        if (!it->second) ready.push_back(it->first);
+
+    while (!ready.empty()) {
+        Event *e = ready.front();
+        ready.pop_front();
+        n--;
+        if (seq) seq->push_back(e);
+        for (list<Cond *>::iterator c = e->post.begin(); c != e->post.end(); c++) {
+            for (list<Event *>::iterator d = (*c)->post.begin(); d != (*c)->post.end(); d++)
+                if (events.test((*d)->id) && !--indeg[*d]) ready.push_back(*d);
+            for (list<Event *>::iterator d = (*c)->read.begin(); d != (*c)->read.end(); d++)
+                if (events.test((*d)->id) && !--indeg[*d]) ready.push_back(*d);
+        }
+        for (list<Cond *>::iterator c = e->read.begin(); c != e->read.end(); c++)
+            for (list<Event *>::iterator d = (*c)->post.begin(); d != (*c)->post.end(); d++)
+                if (events.test((*d)->id) && !--indeg[*d]) ready.push_back(*d);
+    }
+    return n == 0;
+}
+
+/* A causally closed set of events is a configuration if it is conflict free
+   and the asymmetric conflict relation restricted to it is acyclic. */
+bool Unf::isConfiguration(const BitVector &events) const {
+    BitVector conflict;
+    for (int i = events.next(0); i >= 0; i = events.next(i + 1))
+        conflict |= this->events[i]->conflict;
+    return !conflict.intersects(events) && sequence(events, 0);
+}
@@ -2,10 +2,13 @@
 #define NET_H
 
 #include "common.h"
+#include "bitvec.h"
+#include "mem.h"
 
 #include <string>
 #include <list>
 #include <set>
+#include <vector>
 
 using namespace std;
 
@@ -27,38 +30,54 @@ class Hist;
 
 class Place : public Node<Trans> {
 public:
-    list<Cond *> image;
+    typedef list<Cond *, CountingAllocator<Cond *, MEM_IMAGES> > Image;
+
+    Image image;
     uchar mark;
 };
 
 class Trans : public Node<Place> {
 public:
-    list<Event *> image;
+    typedef list<Event *, CountingAllocator<Event *, MEM_IMAGES> > Image;
+
+    Image image;
 };
 
+class EnrichedCond;
+
 class Cond : public Node<Event> {
 public:
     Place *origin;
+    list<EnrichedCond *> ecs;
 };
 
-class Event : public Node<Event> {
+/* past holds the ids of the events in the causal past of the event, the
+   event itself included. conflict holds every older event that shares a
+   precondition with some event of the causal past. Both are fixed once the
+   event is appended, and only have bits below the event's own id. */
+class Event : public Node<Cond> {
 public:
     Trans *origin;
+    list<Hist *> hist;
+
+    BitVector past;
+    BitVector conflict;
 };
 
-#define Coset set<EnrichedCond *>
-#define Coset_iter set<EnrichedCond *>::iterator
+#define Coset set<EnrichedCond *, less<EnrichedCond *>, CountingAllocator<EnrichedCond *, MEM_COSETS> >
+#define Coset_iter Coset::iterator
 
 class EnrichedCond {
 public:
+    uint id;
     Cond *c;
     Hist *h;
 
-    EnrichedCond(Cond *c, Hist *h): c(c), h(h) {}
+    EnrichedCond(uint id, Cond *c, Hist *h): id(id), c(c), h(h) {}
 
     Coset *co();
 private:
-    Coset co_private;
+    set<EnrichedCond *, less<EnrichedCond *>, CountingAllocator<EnrichedCond *, MEM_CO_PRIVATE> > co_private;
 };
 
 class Hist {
@@ -71,6 +90,13 @@ public:
 
     Coset concurrent;
     Coset subsumed;
+
+    BitVector events;   /* events of the history, root included */
+    BitVector conflict; /* union of the conflict labels of its events */
+    vector<uint> order; /* ids of its events in an order they can fire in,
+                           only kept while the history is being extended */
+    BitVector marking;  /* places marked after firing the history */
+    bool cutoff;
 };
 
 class Net {
@@ -78,17 +104,33 @@ public:
     set<Place *> places;
     set<Trans *> transitions;
 
+    ~Net();
+
     void createArc(Place *, Trans *);
     void createArc(Trans *, Place *);
     void createReadArc(Trans *, Place *);
+
+    void slice(const BitVector &target);
 };
 
 class Unf {
 public:
-    set<Cond *> conditions;
-    set<Event *> events;
+    vector<Cond *> conditions;  /* indexed by Cond::id */
+    vector<Event *> events;     /* indexed by Event::id, root first */
 
     Event *root;
+
+    /* Frees the events with their histories and the conditions with their
+       enriched conditions. */
+    ~Unf();
+
+    void label(Event *e);
+    bool causes(const Event *a, const Event *b) const;
+    bool inConflict(const Event *a, const Event *b) const;
+
+    bool consumed(const Cond *c, const BitVector &events) const;
+    bool sequence(const BitVector &events, list<Event *> *seq) const;
+    bool isConfiguration(const BitVector &events) const;
 };
 
 #endif
@@ -0,0 +1,206 @@
+#include "order.h"
+
+#include <algorithm>
+
+/* Events that must come after e: consumers and readers of its
+   postconditions, and consumers of the conditions it reads. */
+static void successors(const Event *e, vector<Event *> &out)
+{
+    for (list<Cond *>::const_iterator c = e->post.begin(); c != e->post.end(); c++) {
+        out.insert(out.end(), (*c)->post.begin(), (*c)->post.end());
+        out.insert(out.end(), (*c)->read.begin(), (*c)->read.end());
+    }
+    for (list<Cond *>::const_iterator c = e->read.begin(); c != e->read.end(); c++)
+        out.insert(out.end(), (*c)->post.begin(), (*c)->post.end());
+}
+
+/* Events that must come before e: producers of its pre- and context
+   conditions, and readers of its preconditions. */
+static void predecessors(const Event *e, vector<Event *> &out)
+{
+    for (list<Cond *>::const_iterator c = e->pre.begin(); c != e->pre.end(); c++) {
+        out.push_back((*c)->pre.front());
+        out.insert(out.end(), (*c)->read.begin(), (*c)->read.end());
+    }
+    for (list<Cond *>::const_iterator c = e->read.begin(); c != e->read.end(); c++)
+        out.push_back((*c)->pre.front());
+}
+
+#define BASE ((uint) -1)
+
+bool AsymOrder::add(const Hist *h)
+{
+    if (!next && h->order.empty() && h != unf->root->hist.front())
+        return add(unf->root->hist.front()) && add(h);
+    if (!next) {
+        grow();
+        for (uint i = 0; i < h->order.size(); i++)
+            pos[h->order[i]] = i;
+        next = h->order.size();
+        set = h->events;
+        base = h;
+        trail.push_back(make_pair(BASE, -1));
+        return true;
+    }
+
+    const vector<BitVector::word> &w = h->events.words;
+    for (uint i = 0; i < w.size(); i++) {
+        BitVector::word fresh = w[i];
+        if (i < set.words.size())
+            fresh &= ~set.words[i];
+        while (fresh) {
+            uint id = i * BitVector::WORD_BITS + __builtin_ctzl(fresh);
+            fresh &= fresh - 1;
+            if (!insert(unf->events[id]))
+                return false;
+        }
+    }
+    return true;
+}
+
+void AsymOrder::undo(uint mark)
+{
+    while (trail.size() > mark) {
+        pair<uint, int> &t = trail.back();
+        if (t.first == BASE) {
+            for (uint i = 0; i < base->order.size(); i++)
+                pos[base->order[i]] = -1;
+            set = BitVector();
+            next = 0;
+            base = 0;
+            trail.pop_back();
+            continue;
+        }
+        if (t.second < 0) {
+            set.reset(t.first);
+            next--;
+        }
+        pos[t.first] = t.second;
+        trail.pop_back();
+    }
+}
+
+/* The ids of the events in the set, in order. */
+void AsymOrder::sequence(vector<uint> &ids) const
+{
+    ids.resize(next);
+    for (int i = set.next(0); i >= 0; i = set.next(i + 1))
+        ids[pos[i]] = i;
+}
+
+void AsymOrder::grow()
+{
+    if (pos.size() < unf->events.size()) {
+        pos.resize(unf->events.size(), -1);
+        seen.resize(unf->events.size(), 0);
+    }
+}
+
+/* Put x last, then fix every successor that is already in the set. */
+bool AsymOrder::insert(Event *x)
+{
+    grow();
+    pos[x->id] = next++;
+    set.set(x->id);
+    trail.push_back(make_pair(x->id, -1));
+
+    vector<Event *> succ;
+    successors(x, succ);
+    for (vector<Event *>::iterator y = succ.begin(); y != succ.end(); y++)
+        if (pos[(*y)->id] >= 0 && pos[(*y)->id] < pos[x->id] && !repair(x, *y))
+            return false;
+    return true;
+}
+
+static bool byPos(const pair<int, Event *> &a, const pair<int, Event *> &b)
+{
+    return a.first < b.first;
+}
+
+/* The edge x -> y goes backwards in the order. Only the events between y
+   and x need to move: those reachable from y go after those reaching x. */
+bool AsymOrder::repair(Event *x, Event *y)
+{
+    int lb = pos[y->id], ub = pos[x->id];
+    vector<Event *> f, b;
+
+    stamp++;
+    if (!forward(y, ub, x, f))
+        return false;
+    backward(x, lb, b);
+
+    vector<pair<int, Event *> > fs, bs;
+    vector<int> slots;
+    for (vector<Event *>::iterator e = f.begin(); e != f.end(); e++) {
+        fs.push_back(make_pair(pos[(*e)->id], *e));
+        slots.push_back(pos[(*e)->id]);
+    }
+    for (vector<Event *>::iterator e = b.begin(); e != b.end(); e++) {
+        bs.push_back(make_pair(pos[(*e)->id], *e));
+        slots.push_back(pos[(*e)->id]);
+    }
+    sort(fs.begin(), fs.end(), byPos);
+    sort(bs.begin(), bs.end(), byPos);
+    sort(slots.begin(), slots.end());
+
+    uint k = 0;
+    for (uint i = 0; i < bs.size(); i++)
+        move(bs[i].second, slots[k++]);
+    for (uint i = 0; i < fs.size(); i++)
+        move(fs[i].second, slots[k++]);
+    return true;
+}
+
+/* Collect the events reachable from v that are placed before ub; reaching
+   x closes a cycle. */
+bool AsymOrder::forward(Event *v, int ub, Event *x, vector<Event *> &found)
+{
+    vector<Event *> stack(1, v), succ;
+    seen[v->id] = stamp;
+    while (!stack.empty()) {
+        Event *e = stack.back();
+        stack.pop_back();
+        found.push_back(e);
+        succ.clear();
+        successors(e, succ);
+        for (vector<Event *>::iterator w = succ.begin(); w != succ.end(); w++) {
+            if (*w == x)
+                return false;
+            int p = pos[(*w)->id];
+            if (p >= 0 && p < ub && seen[(*w)->id] != stamp) {
+                seen[(*w)->id] = stamp;
+                stack.push_back(*w);
+            }
+        }
+    }
+    return true;
+}
+
+/* Collect the events reaching v that are placed after lb. */
+void AsymOrder::backward(Event *v, int lb, vector<Event *> &found)
+{
+    vector<Event *> stack(1, v), pred;
+    seen[v->id] = stamp;
+    while (!stack.empty()) {
+        Event *e = stack.back();
+        stack.pop_back();
+        found.push_back(e);
+        pred.clear();
+        predecessors(e, pred);
+        for (vector<Event *>::iterator w = pred.begin(); w != pred.end(); w++) {
+            int p = pos[(*w)->id];
+            if (p >= 0 && p > lb && seen[(*w)->id] != stamp) {
+                seen[(*w)->id] = stamp;
+                stack.push_back(*w);
+            }
+        }
+    }
+}
+
+void AsymOrder::move(Event *e, int p)
+{
+    if (pos[e->id] == p)
+        return;
+    trail.push_back(make_pair(e->id, pos[e->id]));
+    pos[e->id] = p;
+}
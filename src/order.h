@@ -0,0 +1,45 @@
+#ifndef ORDER_H
+#define ORDER_H
+
+#include "net.h"
+
+/* A growing set of events kept in a topological order of asymmetric
+   conflict (which includes causality). Adding a history only inserts its
+   events that are not in the set yet; whenever one of them has to precede
+   an event placed before it, the order is repaired locally (Pearce and
+   Kelly), and a cycle found on the way means the set is no configuration.
+   Every change goes on a trail so that a search can undo additions.
+   The first history added to an empty order takes the order it was
+   created with, without any checks, if it still has it; otherwise the
+   order starts from the empty history and the events are inserted. */
+class AsymOrder {
+public:
+    AsymOrder(const Unf *unf): unf(unf), base(0), next(0), stamp(0) {}
+
+    bool add(const Hist *h);
+    uint mark() const { return trail.size(); }
+    void undo(uint mark);
+    void sequence(vector<uint> &ids) const;
+
+    const BitVector &events() const { return set; }
+
+private:
+    const Unf *unf;
+    const Hist *base;
+    BitVector set;
+    vector<int> pos;
+    vector<uint> seen;
+    int next;
+    uint stamp;
+    vector<pair<uint, int> > trail;   /* event id, previous position */
+
+    void grow();
+
+    bool insert(Event *x);
+    bool repair(Event *x, Event *y);
+    bool forward(Event *v, int ub, Event *x, vector<Event *> &found);
+    void backward(Event *v, int lb, vector<Event *> &found);
+    void move(Event *e, int p);
+};
+
+#endif
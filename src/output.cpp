@@ -1 +1,185 @@
 #include "output.h"
+#include "unf.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+template <class T> static bool byId(const T *a, const T *b)
+{
+    return a->id < b->id;
+}
+
+template <> void writeDot(ostream &out, Net *net)
+{
+    vector<Place *> places(net->places.begin(), net->places.end());
+    vector<Trans *> trans(net->transitions.begin(), net->transitions.end());
+    sort(places.begin(), places.end(), byId<Place>);
+    sort(trans.begin(), trans.end(), byId<Trans>);
+
+    out << "digraph net {" << endl;
+    for (vector<Place *>::iterator p = places.begin(); p != places.end(); p++)
+        out << "  p" << (*p)->id << " [shape=circle label=\"" << (*p)->name
+            << ((*p)->mark? "\\n*" : "") << "\"];" << endl;
+    for (vector<Trans *>::iterator t = trans.begin(); t != trans.end(); t++) {
+        out << "  t" << (*t)->id << " [shape=box label=\"" << (*t)->name << "\"];" << endl;
+        for (list<Place *>::iterator p = (*t)->pre.begin(); p != (*t)->pre.end(); p++)
+            out << "  p" << (*p)->id << " -> t" << (*t)->id << ";" << endl;
+        for (list<Place *>::iterator p = (*t)->post.begin(); p != (*t)->post.end(); p++)
+            out << "  t" << (*t)->id << " -> p" << (*p)->id << ";" << endl;
+        for (list<Place *>::iterator p = (*t)->read.begin(); p != (*t)->read.end(); p++)
+            out << "  p" << (*p)->id << " -> t" << (*t)->id << " [dir=none];" << endl;
+    }
+    out << "}" << endl;
+}
+
+/* PEP low level net, readable by read_pep_net. Places and transitions are
+   numbered from 1 in the order of their ids. */
+template <> void writeLL(ostream &out, Net *net)
+{
+    vector<Place *> places(net->places.begin(), net->places.end());
+    vector<Trans *> trans(net->transitions.begin(), net->transitions.end());
+    sort(places.begin(), places.end(), byId<Place>);
+    sort(trans.begin(), trans.end(), byId<Trans>);
+    map<Place *, uint> pn;
+    map<Trans *, uint> tn;
+
+    out << "PEP\nPTNet\nFORMAT_N2\nPL\n";
+    for (uint i = 0; i < places.size(); i++) {
+        pn[places[i]] = i + 1;
+        out << i + 1 << "\"" << places[i]->name << "\"";
+        if (places[i]->mark)
+            out << "M1m1";
+        out << "\n";
+    }
+    out << "TR\n";
+    for (uint i = 0; i < trans.size(); i++) {
+        tn[trans[i]] = i + 1;
+        out << i + 1 << "\"" << trans[i]->name << "\"\n";
+    }
+    out << "TP\n";
+    for (vector<Trans *>::iterator t = trans.begin(); t != trans.end(); t++)
+        for (list<Place *>::iterator p = (*t)->post.begin(); p != (*t)->post.end(); p++)
+            out << tn[*t] << "<" << pn[*p] << "\n";
+    out << "PT\n";
+    for (vector<Trans *>::iterator t = trans.begin(); t != trans.end(); t++)
+        for (list<Place *>::iterator p = (*t)->pre.begin(); p != (*t)->pre.end(); p++)
+            out << pn[*p] << ">" << tn[*t] << "\n";
+    out << "RA\n";
+    for (vector<Trans *>::iterator t = trans.begin(); t != trans.end(); t++)
+        for (list<Place *>::iterator p = (*t)->read.begin(); p != (*t)->read.end(); p++)
+            out << tn[*t] << "<" << pn[*p] << "\n";
+}
+
+static void writeInt(ostream &out, int i)
+{
+    out.write((const char *) &i, sizeof(int));
+}
+
+/* Names by id, empty where slicing removed a node; ids start at 1. */
+template <class T> static void writeNames(ostream &out, const set<T *> &nodes, uint max)
+{
+    vector<const string *> names(max + 1, 0);
+    for (typename set<T *>::const_iterator n = nodes.begin(); n != nodes.end(); n++)
+        names[(*n)->id] = &(*n)->name;
+    for (uint i = 1; i <= max; i++) {
+        if (names[i])
+            out << *names[i];
+        out << '\0';
+    }
+    out << '\0';
+}
+
+/* Mole's binary prefix format, with native ints: the numbers of conditions
+   and events, the transition of every event, then for every condition its
+   place, its preset event (0 for the initial ones) and its postset events
+   ending with 0. Then pairs of cutoff events and their corresponding
+   events, ending with 0, an empty list of queries, the numbers of places
+   and transitions, the length of the longest name, and the names of the
+   places and of the transitions, each list ending with an empty name.
+   Conditions and events are numbered from 1.
+
+   Contextual information follows, where readers of the plain format stop:
+   for every condition the events reading it, ending with 0; then the
+   number of histories, and for each one its event, cutoff flag, size and
+   enriched conditions as (history, condition) pairs after their count.
+   History 0 is the empty one, the others are numbered in order of their
+   events. An event counts as a cutoff when all its histories are. */
+template <> void writeMci(ostream &out, Unfolder *u)
+{
+    const Unf *unf = u->unf;
+    Net *net = u->net;
+    uint numco = unf->conditions.size(), numev = unf->events.size() - 1;
+
+    writeInt(out, numco);
+    writeInt(out, numev);
+    for (uint i = 1; i <= numev; i++)
+        writeInt(out, unf->events[i]->origin->id);
+    for (uint i = 0; i < numco; i++) {
+        Cond *c = unf->conditions[i];
+        writeInt(out, c->origin->id);
+        writeInt(out, c->pre.front()->id);
+        for (list<Event *>::iterator e = c->post.begin(); e != c->post.end(); e++)
+            writeInt(out, (*e)->id);
+        writeInt(out, 0);
+    }
+
+    for (uint i = 1; i <= numev; i++) {
+        Event *e = unf->events[i];
+        bool cutoff = true;
+        for (list<Hist *>::iterator h = e->hist.begin(); h != e->hist.end(); h++)
+            cutoff &= (*h)->cutoff;
+        if (!cutoff)
+            continue;
+        Hist *corr = u->corresponding(e->hist.front());
+        writeInt(out, i);
+        writeInt(out, corr? corr->event->id : 0);
+    }
+    writeInt(out, 0);
+    writeInt(out, 0);
+
+    uint maxpl = 0, maxtr = 0, len = 0;
+    for (set<Place *>::iterator p = net->places.begin(); p != net->places.end(); p++) {
+        maxpl = max(maxpl, (*p)->id);
+        len = max(len, (uint) (*p)->name.size());
+    }
+    for (set<Trans *>::iterator t = net->transitions.begin(); t != net->transitions.end(); t++) {
+        maxtr = max(maxtr, (*t)->id);
+        len = max(len, (uint) (*t)->name.size());
+    }
+    writeInt(out, maxpl);
+    writeInt(out, maxtr);
+    writeInt(out, len);
+    writeNames(out, net->places, maxpl);
+    writeNames(out, net->transitions, maxtr);
+
+    for (uint i = 0; i < numco; i++) {
+        Cond *c = unf->conditions[i];
+        for (list<Event *>::iterator e = c->read.begin(); e != c->read.end(); e++)
+            writeInt(out, (*e)->id);
+        writeInt(out, 0);
+    }
+    map<Hist *, uint> number;
+    vector<Hist *> hists;
+    for (uint i = 0; i <= numev; i++)
+        for (list<Hist *>::iterator h = unf->events[i]->hist.begin();
+                h != unf->events[i]->hist.end(); h++) {
+            number[*h] = hists.size();
+            hists.push_back(*h);
+        }
+    writeInt(out, hists.size());
+    for (uint i = 0; i < hists.size(); i++) {
+        Hist *h = hists[i];
+        writeInt(out, h->event->id);
+        writeInt(out, h->cutoff);
+        writeInt(out, h->size);
+        /* By id, not by address, so that the file is the same every run. */
+        vector<EnrichedCond *> pred(h->pred.begin(), h->pred.end());
+        sort(pred.begin(), pred.end(), byId<EnrichedCond>);
+        writeInt(out, pred.size());
+        for (uint j = 0; j < pred.size(); j++) {
+            writeInt(out, number[pred[j]->h]);
+            writeInt(out, pred[j]->c->id + 1);
+        }
+    }
+}
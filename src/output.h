@@ -16,4 +16,14 @@ template <class T> void writeAsp(ostream &out, T *net) {
 
 }
 
+template <class T> void writeMci(ostream &out, T *net) {
+
+}
+
+class Unfolder;
+
+template <> void writeDot(ostream &out, Net *net);
+template <> void writeLL(ostream &out, Net *net);
+template <> void writeMci(ostream &out, Unfolder *unf);
+
 #endif // OUTPUT_H
@@ -0,0 +1,125 @@
+#include "progress.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <time.h>
+#include <unistd.h>
+
+/* How often the snapshot is rewritten when no interval is given. */
+#define STATS_FILE_SECONDS 1
+
+static double now()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void Monitor::start()
+{
+    started = last = now();
+    lastEvents = 0;
+    running = true;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&lock, 0);
+    if (pthread_create(&thread, 0, watch, this)) {
+        cerr << "could not create thread\n"; exit(1);
+    }
+}
+
+void Monitor::stop()
+{
+    pthread_mutex_lock(&lock);
+    running = false;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, 0);
+    report(now(), timedOut? "timeout" : "finished", false);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+}
+
+void *Monitor::watch(void *arg)
+{
+    Monitor *m = (Monitor *) arg;
+    uint period = m->interval? m->interval : STATS_FILE_SECONDS;
+    bool reports = m->interval || m->statsFile;
+    double next = m->started + period;
+
+    pthread_mutex_lock(&m->lock);
+    while (m->running) {
+        double until = reports? next : 0;
+        if (m->limit && !m->timedOut && (!until || m->started + m->limit < until))
+            until = m->started + m->limit;
+        if (!until) {
+            pthread_cond_wait(&m->wake, &m->lock);
+            continue;
+        }
+        timespec ts;
+        ts.tv_sec = (time_t) until;
+        ts.tv_nsec = (long) ((until - ts.tv_sec) * 1e9);
+        pthread_cond_timedwait(&m->wake, &m->lock, &ts);
+        if (!m->running)
+            break;
+
+        double t = now();
+        if (m->limit && !m->timedOut && t >= m->started + m->limit) {
+            m->timedOut = true;
+            m->unf->cancel();
+        }
+        if (reports && t >= next) {
+            m->report(t, "running", m->interval != 0);
+            while (next <= t)
+                next += period;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+/* Sample the counters; print them if asked to, and rewrite the snapshot.
+   The rate is over the time since the previous sample. */
+void Monitor::report(double t, const char *state, bool print)
+{
+    UnfoldCounters c;
+    c.events = __atomic_load_n(&unf->counters.events, __ATOMIC_RELAXED);
+    c.conditions = __atomic_load_n(&unf->counters.conditions, __ATOMIC_RELAXED);
+    c.histories = __atomic_load_n(&unf->counters.histories, __ATOMIC_RELAXED);
+    c.cutoffs = __atomic_load_n(&unf->counters.cutoffs, __ATOMIC_RELAXED);
+    c.queue = __atomic_load_n(&unf->counters.queue, __ATOMIC_RELAXED);
+    c.memory = __atomic_load_n(&unf->counters.memory, __ATOMIC_RELAXED);
+    double rate = t > last? (c.events - lastEvents) / (t - last) : 0;
+    last = t;
+    lastEvents = c.events;
+
+    if (print)
+        cerr << "Progress: " << (uint) (t - started) << " s, " << c.events
+             << " events, " << c.conditions << " conditions, " << c.histories
+             << " histories, " << c.cutoffs << " cutoffs, " << c.queue
+             << " queued, " << (uint) rate << " events/s, " << c.memory
+             << " bytes" << endl;
+
+    if (!statsFile)
+        return;
+    ostringstream tmp;
+    tmp << statsFile << ".tmp." << getpid();
+    {
+        ofstream out(tmp.str().c_str());
+        out << "{\"state\": \"" << state << "\", \"seconds\": " << t - started
+            << ", \"events\": " << c.events << ", \"conditions\": " << c.conditions
+            << ", \"histories\": " << c.histories << ", \"cutoffs\": " << c.cutoffs
+            << ", \"queue\": " << c.queue << ", \"events_per_second\": " << rate
+            << ", \"memory_bytes\": " << c.memory << "}" << endl;
+        if (!out) {
+            unlink(tmp.str().c_str());
+            return;
+        }
+    }
+    if (rename(tmp.str().c_str(), statsFile) != 0)
+        unlink(tmp.str().c_str());
+}
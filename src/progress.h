@@ -0,0 +1,44 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <pthread.h>
+
+#include "unf.h"
+
+/* A thread watching a running Unfolder through its counters: every
+   interval seconds it prints them to cerr and rewrites the JSON snapshot
+   in statsFile, and once limit seconds have passed it cancels the
+   unfolding. The snapshot is written to a temporary file and renamed, so
+   readers only ever see complete ones. Zero turns the report or the limit
+   off. */
+class Monitor {
+public:
+  Monitor(Unfolder *unf): unf(unf), interval(0), statsFile(0), limit(0),
+                          timedOut(false), running(false) {}
+
+  Unfolder *unf;
+  uint interval;
+  const char *statsFile;
+  uint limit;
+
+  /* Set once the time limit has cancelled the unfolding. */
+  volatile bool timedOut;
+
+  void start();
+
+  /* Stop the thread and write the final snapshot. */
+  void stop();
+
+private:
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool running;
+  double started, last;
+  uint lastEvents;
+
+  static void *watch(void *arg);
+  void report(double now, const char *state, bool print);
+};
+
+#endif
@@ -11,11 +11,15 @@
 #include <iostream>
 #include <cctype>
 #include <cstring>
+#include <string>
 #include <vector>
 
+#include <pthread.h>
+
 #include "readlib.h"
 #include "net.h"
 #include "common.h"
+#include "trace.h"
 
 /*****************************************************************************/
 
@@ -71,12 +75,12 @@ typedef struct
 /* not restricted to nets (though in practice that's the only thing we'll    */
 /* use it for). blocks is a data structure telling us how the layout of a    */
 /* file should look like, and dest tells us what we should do with the data  */
-/* we find (what and where to store it).				     */
+/* we find (what and where to store it). The file is opened here unless    */
+/* infile is given; it is closed in either case.			     */
 
-void read_PEP_file(char *filename, const char **types,
+void read_PEP_file(char *filename, FILE *infile, const char **types,
 		   t_blockinfo *blocks, t_blockdest *dest)
 {
-    FILE *infile;
     t_lookup *tbl;
     t_fieldinfo *fld;
     t_dest *dst;
@@ -88,7 +92,7 @@ void read_PEP_file(char *filename, const char **types,
     HLinput_line = 1;
 
     /* Open the file, read the header. */
-    if (!(infile = fopen(filename, "r"))) {
+    if (!infile && !(infile = fopen(filename, "r"))) {
         cerr << "could not open file for reading\n"; exit(1);
     }
 
@@ -124,6 +128,7 @@ void read_PEP_file(char *filename, const char **types,
             { cerr << "keyword '" << blocks->name << "' expected\n"; exit(1); }
 
         if (!blocks->name) { cerr << "unknown keyword '" << sbuf << "'\n"; exit(1); }
+        TRACE_SPAN(blocks->name);
 
         for (dest = sdest; dest->name; dest++)
             if (!strcmp(blocks->name,dest->name)) break;
@@ -476,6 +481,7 @@ int insert_place()
     if (rd_ident && rd_ident != placecount) autonumbering = 0;
     if (!rd_ident && autonumbering) rd_ident = placecount;
     if (!rd_ident) { cerr << "missing place identifier\n"; exit(1); }
+    if (rd_ident < 0) { cerr << "negative place identifier\n"; exit(1); }
 
     if (rd_ident > AnzPlNamen)
         AnzPlNamen = rd_ident;
@@ -507,6 +513,7 @@ int insert_trans()
     if (rd_ident && rd_ident != transcount) autonumbering = 0;
     if (!rd_ident && autonumbering) rd_ident = transcount;
     if (!rd_ident) { cerr << "missing transition identifier\n"; exit(1); }
+    if (rd_ident < 0) { cerr << "negative transition identifier\n"; exit(1); }
 
     if (rd_ident > AnzTrNamen)
         AnzTrNamen = rd_ident;
@@ -545,9 +552,9 @@ int insert_arc()
     pl = tp? rd_co->y : rd_co->x;
     tr = tp? rd_co->x : rd_co->y;
 
-    if (!tr || (tr > AnzTrNamen) || !TrArray[tr])
+    if (tr <= 0 || (tr > AnzTrNamen) || !TrArray[tr])
     { cerr << "arc: incorrect transition identifier\n"; exit(1); }
-    if (!pl || (pl > AnzPlNamen) || !PlArray[pl] )
+    if (pl <= 0 || (pl > AnzPlNamen) || !PlArray[pl] )
     { cerr << "arc: incorrect place identifier\n"; exit(1); }
 
     tp? rd_net->createArc(//nc_create_arc(&(TrArray[tr]->postset),&(PlArray[pl]->preset),
@@ -561,9 +568,9 @@ int insert_ra()
 {
     int tr = rd_co->x, pl = rd_co->y;
 
-    if (!tr || (tr > AnzTrNamen) || !TrArray[tr])
+    if (tr <= 0 || (tr > AnzTrNamen) || !TrArray[tr])
     { cerr << "readarc: incorrect transition identifier\n"; exit(1); }
-    if (!pl || (pl > AnzPlNamen) || !PlArray[pl] )
+    if (pl <= 0 || (pl > AnzPlNamen) || !PlArray[pl] )
     { cerr << "readarc: incorrect place identifier\n"; exit(1); }
 
     rd_net->createReadArc(//nc_create_arc(&(TrArray[tr]->readarcs),&(PlArray[pl]->readarcs),
@@ -574,7 +581,7 @@ int insert_ra()
 /*****************************************************************************/
 /* The main function of this file: read a PEP file into a net_t structure.   */
 
-Net* read_pep_net(char *PEPfilename)
+static Net* read_net(char *PEPfilename, FILE *infile)
 {
     /* These tables instruct read_PEP_net where contents
     of certain fields should be stored.		    */
@@ -624,7 +631,452 @@ Net* read_pep_net(char *PEPfilename)
     autonumbering = 1;
 
     /* Read the net */
-    read_PEP_file(PEPfilename, type_llnet, netblocks, netdest);
+    read_PEP_file(PEPfilename, infile, type_llnet, netblocks, netdest);
+
+    PlArray.resize(0);
+    TrArray.resize(0);
+    return rd_net;
+}
+
+Net* read_pep_net(char *PEPfilename)
+{
+    return read_net(PEPfilename, NULL);
+}
+
+Net* read_pep_buffer(const char *data, size_t size)
+{
+    static char name[] = "(buffer)";
+    FILE *infile = fmemopen((void *) data, size, "r");
+    if (!infile) { cerr << "could not read buffer\n"; exit(1); }
+    return read_net(name, infile);
+}
+
+/*****************************************************************************/
+/* read_pep_net_parallel						     */
+/* The same as read_pep_net, in three passes: the blocks of the file are     */
+/* found first, then their lines are tokenized by several threads in chunks  */
+/* of PAR_CHUNK lines, the places and transitions are entered in file order  */
+/* by insert_place and insert_trans, and finally the arcs are attached by    */
+/* several threads, each owning a range of place and transition ids. The     */
+/* tokenizer follows read_PEP_file character by character; whatever it is   */
+/* not sure to read the same way (comments, fields running over the end of   */
+/* a line, syntax errors) makes it give up, and the file is then read by     */
+/* read_PEP_file, which also reports the errors.			     */
+
+#define PAR_CHUNK 4096
+
+enum { PD_NONE, PD_PL, PD_TR, PD_TP, PD_PT, PD_RA };
+
+/* What the dest tables of read_net keep of a line. */
+typedef struct
+{
+    char entity;		/* not an empty line			     */
+    char named, coords;
+    const char *name;		/* in the file buffer, not terminated	     */
+    int namelen;
+    int ident, marked, x, y;
+} t_parline;
+
+typedef struct
+{
+    int dest;
+    char type[128];
+    vector<const char*> lines;	/* where every line of the block starts	     */
+    vector<t_parline> parsed;
+} t_section;
+
+typedef struct
+{
+    vector<t_section> *sections;
+    vector<pair<int,int> > *jobs;	/* section and first line	     */
+    pthread_mutex_t *lock;
+    int *next;
+    volatile int *failed;
+} t_parwork;
+
+typedef struct
+{
+    char dest;
+    int pl, tr;
+} t_pararc;
+
+/* Each thread sorts out a range of the arcs by the thread that owns     */
+/* their place and their transition (ids id/width), into                 */
+/* byplace[self*threads+owner] and bytrans[self*threads+owner]; then     */
+/* each thread attaches the arcs of its own places and transitions.     */
+typedef struct
+{
+    vector<t_pararc> *arcs;
+    vector<vector<int> > *byplace, *bytrans;
+    size_t first, last;
+    int plwidth, trwidth, self, threads;
+} t_arcwork;
+
+/* ReadCharComment within a line; 0 on a comment. */
+static char par_char(const char *&p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\b') p++;
+    return *p == '%'? 0 : *p++;
+}
+
+/* ReadWhiteSpace, but 0 instead of going on to the next line. */
+static char par_space(const char *&p)
+{
+    while (*p != '\n' && isspace((unsigned char) *p)) p++;
+    return *p == '\n'? 0 : *p++;
+}
+
+static int par_number(const char *&p, int *result)
+{
+    int number, vorz = 1;
+    char digit = par_space(p);
+
+    if (digit == '-')
+    {
+        vorz = -1;
+        digit = par_space(p);
+    }
+    if (!isdigit((unsigned char) digit)) return 0;
+    number = digit - '0';
+    while (isdigit((unsigned char) *p))
+        number = number * 10 + *p++ - '0';
+    *result = vorz * number;
+    return 1;
+}
+
+static int par_string(const char *&p, const char **str, int *len)
+{
+    char delimiter = par_char(p);
+
+    if (delimiter != '\'' && delimiter != '"') return 0;
+    for (*str = p; *p != delimiter && *p != '\n'; p++);
+    if (*p != delimiter) return 0;
+    *len = p++ - *str;
+    return 1;
+}
+
+/* ReadCmdToken; the token goes to tok. */
+static int par_token(const char *&p, string &tok)
+{
+    const char *start;
+
+    if (!isalnum((unsigned char) par_char(p))) return 0;
+    for (start = p - 1; isalnum((unsigned char) *p) || *p == '_'; p++);
+    tok.assign(start, p - start);
+    return 1;
+}
+
+/* One line of a block, from its start (or from after the keyword of a block */
+/* of type TB_LINE) to its newline, as the loop in read_PEP_file reads it.   */
+static int par_line(const t_section &s, const char *p, t_parline *r)
+{
+    char ch = par_char(p);
+    int num = 0, num2 = 0, len = 0;
+    const char *str = NULL;
+
+    memset(r, 0, sizeof(t_parline));
+    if (!ch) return 0;
+    if (ch == '\n') return 1;
+    r->entity = 1;
+
+    while (ch != '\n')
+    {
+        if (isdigit((unsigned char) ch) || ch == '-')
+        {
+            p--;
+            if (!par_number(p, &num)) return 0;
+            if ((ch = par_space(p)) == '@' || ch == '<' || ch == '>')
+            {
+                ch = '@';
+                if (!par_number(p, &num2)) return 0;
+            }
+            else if (!ch) return 0;
+            else
+            {
+                p--;
+                ch = '0';
+            }
+        }
+        else
+        {
+            if ((unsigned char) ch < ' ' || (unsigned char) ch >= 128) return 0;
+            if (ch == '\'' || ch == '"') p--;
+            switch(s.type[(int)ch])
+            {
+            case FT_STRING:
+                if (!par_string(p, &str, &len)) return 0;
+                break;
+            case FT_NUMBER:
+                if (!par_number(p, &num)) return 0;
+                break;
+            case FT_COORDS:
+                if (!par_number(p, &num) || par_space(p) != '@'
+                        || !par_number(p, &num2)) return 0;
+                break;
+            case FT_FLAG:
+                break;
+            default:
+                return 0;
+            }
+        }
+
+        switch(s.type[(int)ch])
+        {
+        case FT_STRING:
+            if (ch == '\'' || ch == '"')
+                r->named = 1, r->name = str, r->namelen = len;
+            break;
+        case FT_NUMBER:
+            if (ch == '0') r->ident = num;
+            else if (ch == 'M') r->marked = num;
+            break;
+        case FT_COORDS:
+            if (ch == '@') r->coords = 1, r->x = num, r->y = num2;
+            break;
+        }
+        if (!(ch = par_char(p))) return 0;
+    }
+    return 1;
+}
+
+/* Split the file into its blocks, checking the header and the order of the */
+/* blocks as read_PEP_file does. The buffer ends with a newline.	     */
+static int par_scan(const char *buf, const char *end, vector<t_section> &sections)
+{
+    const char *p = buf;
+    const char **types;
+    t_blockinfo *blocks = netblocks;
+    t_fieldinfo *fld;
+    string tok;
+
+    if (!par_token(p, tok) || tok != "PEP") return 0;
+    p = (const char*) memchr(p, '\n', end - p) + 1;
+    if (p == end || !par_token(p, tok)) return 0;
+    for (types = type_llnet; *types && tok != *types; types++);
+    if (!*types) return 0;
+    p = (const char*) memchr(p, '\n', end - p) + 1;
+    if (p == end || !par_token(p, tok) || tok.compare(0, 8, "FORMAT_N")) return 0;
+    p = (const char*) memchr(p, '\n', end - p) + 1;
+
+    while (p != end)
+    {
+        if (!par_token(p, tok)) return 0;
+        for (; blocks->name && tok != blocks->name; blocks++)
+            if (!blocks->optional) return 0;
+        if (!blocks->name) return 0;
+
+        sections.push_back(t_section());
+        t_section &s = sections.back();
+        s.dest = tok == "PL"? PD_PL : tok == "TR"? PD_TR : tok == "TP"? PD_TP
+               : tok == "PT"? PD_PT : tok == "RA"? PD_RA : PD_NONE;
+        memset(s.type, 0, sizeof(s.type));
+        for (fld = blocks->field; fld->c; fld++)
+            s.type[(int)fld->c] = fld->type;
+
+        if (!blocks->line) p = (const char*) memchr(p, '\n', end - p) + 1;
+        while (p != end)
+        {
+            const char *q = p;
+            while (*q == ' ' || *q == '\t' || *q == '\b') q++;
+            if (*q == '%') return 0;
+            if (isupper((unsigned char) q[0]) && isupper((unsigned char) q[1])) break;
+            s.lines.push_back(p);
+            p = (const char*) memchr(p, '\n', end - p) + 1;
+        }
+        blocks++;
+    }
+
+    for (; blocks->name; blocks++)
+        if (!blocks->optional) return 0;
+    return 1;
+}
+
+static void *par_tokenize(void *arg)
+{
+    t_parwork *w = (t_parwork*) arg;
+    int i, job;
+
+    for (;;)
+    {
+        pthread_mutex_lock(w->lock);
+        job = (*w->next)++;
+        pthread_mutex_unlock(w->lock);
+        if (job >= (int) w->jobs->size() || *w->failed) break;
+
+        TRACE_SPAN("tokenize chunk");
+        t_section &s = (*w->sections)[(*w->jobs)[job].first];
+        int first = (*w->jobs)[job].second;
+        int last = first + PAR_CHUNK < (int) s.lines.size()? first + PAR_CHUNK : s.lines.size();
+        for (i = first; i < last; i++)
+            if (!par_line(s, s.lines[i], &s.parsed[i])) { *w->failed = 1; break; }
+    }
+    return NULL;
+}
+
+/* Arcs in file order, so that every list of a node gets them in the order */
+/* read_PEP_file would have added them.					     */
+static void *par_split(void *arg)
+{
+    t_arcwork *w = (t_arcwork*) arg;
+    vector<t_pararc> &arcs = *w->arcs;
+    size_t i;
+
+    TRACE_SPAN("split arcs");
+    for (i = w->first; i < w->last; i++)
+    {
+        (*w->byplace)[w->self * w->threads + arcs[i].pl / w->plwidth].push_back(i);
+        (*w->bytrans)[w->self * w->threads + arcs[i].tr / w->trwidth].push_back(i);
+    }
+    return NULL;
+}
+
+/* Ranges in thread order, so in file order. */
+static void *par_attach(void *arg)
+{
+    t_arcwork *w = (t_arcwork*) arg;
+    vector<t_pararc> &arcs = *w->arcs;
+    size_t i;
+    int k;
+
+    TRACE_SPAN("attach arcs");
+    for (k = 0; k < w->threads; k++)
+    {
+        vector<int> &pl = (*w->byplace)[k * w->threads + w->self];
+        vector<int> &tr = (*w->bytrans)[k * w->threads + w->self];
+        for (i = 0; i < pl.size(); i++)
+        {
+            t_pararc &a = arcs[pl[i]];
+            Place *p = PlArray[a.pl];
+            (a.dest == PD_TP? p->pre : a.dest == PD_PT? p->post : p->read).push_back(TrArray[a.tr]);
+        }
+        for (i = 0; i < tr.size(); i++)
+        {
+            t_pararc &a = arcs[tr[i]];
+            Trans *t = TrArray[a.tr];
+            (a.dest == PD_TP? t->post : a.dest == PD_PT? t->pre : t->read).push_back(PlArray[a.pl]);
+        }
+    }
+    return NULL;
+}
+
+static void par_threads(int threads, void *(*func)(void*), void *work, size_t size)
+{
+    vector<pthread_t> tid(threads);
+    int k;
+
+    for (k = 0; k < threads; k++)
+        if (pthread_create(&tid[k], NULL, func, (char*) work + k * size))
+        { cerr << "could not create thread\n"; exit(1); }
+    for (k = 0; k < threads; k++)
+        pthread_join(tid[k], NULL);
+}
+
+Net* read_pep_net_parallel(char *PEPfilename, int threads)
+{
+    vector<char> buf;
+    vector<t_section> sections;
+    vector<pair<int,int> > jobs;
+    vector<t_pararc> arcs;
+    size_t size, i, j;
+    int k, count, next = 0;
+    volatile int failed = 0;
+    FILE *infile;
+
+    if (threads < 1) threads = 1;
+    if (!(infile = fopen(PEPfilename, "r"))) return read_pep_net(PEPfilename);
+    fseek(infile, 0, SEEK_END);
+    size = ftell(infile);
+    rewind(infile);
+    buf.resize(size + 1);
+    size = fread(&buf[0], 1, size, infile);
+    fclose(infile);
+
+    /* NUL counts as white space for ReadCharComment; leave that to it. */
+    if (!size || buf[size-1] != '\n' || memchr(&buf[0], '\0', size))
+        return read_pep_net(PEPfilename);
+    {
+        TRACE_SPAN("scan blocks");
+        if (!par_scan(&buf[0], &buf[size], sections))
+            return read_pep_net(PEPfilename);
+    }
+
+    for (i = 0; i < sections.size(); i++)
+    {
+        sections[i].parsed.resize(sections[i].lines.size());
+        for (j = 0; j < sections[i].lines.size(); j += PAR_CHUNK)
+            jobs.push_back(make_pair((int) i, (int) j));
+    }
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    vector<t_parwork> work(threads);
+    for (k = 0; k < threads; k++)
+    {
+        t_parwork w = { &sections, &jobs, &lock, &next, &failed };
+        work[k] = w;
+    }
+    par_threads(threads, par_tokenize, &work[0], sizeof(t_parwork));
+    if (failed) return read_pep_net(PEPfilename);
+
+    /* Lines read_net would stop on without a message. */
+    for (i = 0; i < sections.size(); i++)
+        for (j = 0; j < sections[i].parsed.size(); j++)
+        {
+            t_parline &r = sections[i].parsed[j];
+            if (!r.entity) continue;
+            if ((sections[i].dest == PD_PL || sections[i].dest == PD_TR) && !r.named)
+                return read_pep_net(PEPfilename);
+            if (sections[i].dest >= PD_TP && !r.coords)
+                return read_pep_net(PEPfilename);
+        }
+
+    PlArray.resize(count = MaxPlNamen = MaxTrNamen = NAMES_START);
+    TrArray.resize(count);
+    AnzPlNamen = AnzTrNamen = 0;
+    while (--count)
+        PlArray[count] = NULL, TrArray[count] = NULL;
+    rd_net = new Net();
+    placecount = transcount = 0;
+    autonumbering = 1;
+
+    for (i = 0; i < sections.size(); i++)
+    {
+        t_section &s = sections[i];
+        for (j = 0; j < s.parsed.size(); j++)
+        {
+            t_parline &r = s.parsed[j];
+            if (!r.entity || s.dest == PD_NONE) continue;
+            if (s.dest == PD_PL || s.dest == PD_TR)
+            {
+                string name(r.name, r.namelen);
+                rd_name = (char*) name.c_str();
+                rd_ident = r.ident;
+                rd_marked = r.marked;
+                s.dest == PD_PL? insert_place() : insert_trans();
+                continue;
+            }
+
+            /* The checks of insert_arc and insert_ra, in the same order. */
+            t_pararc a = { (char) s.dest, s.dest == PD_PT? r.x : r.y,
+                           s.dest == PD_PT? r.y : r.x };
+            const char *what = s.dest == PD_RA? "readarc" : "arc";
+            if (a.tr <= 0 || (a.tr > AnzTrNamen) || !TrArray[a.tr])
+            { cerr << what << ": incorrect transition identifier\n"; exit(1); }
+            if (a.pl <= 0 || (a.pl > AnzPlNamen) || !PlArray[a.pl] )
+            { cerr << what << ": incorrect place identifier\n"; exit(1); }
+            arcs.push_back(a);
+        }
+    }
+
+    vector<vector<int> > byplace(threads * threads), bytrans(threads * threads);
+    vector<t_arcwork> attach(threads);
+    for (k = 0; k < threads; k++)
+    {
+        t_arcwork w = { &arcs, &byplace, &bytrans,
+                        arcs.size() * k / threads, arcs.size() * (k + 1) / threads,
+                        AnzPlNamen / threads + 1, AnzTrNamen / threads + 1, k, threads };
+        attach[k] = w;
+    }
+    par_threads(threads, par_split, &attach[0], sizeof(t_arcwork));
+    par_threads(threads, par_attach, &attach[0], sizeof(t_arcwork));
 
     PlArray.resize(0);
     TrArray.resize(0);
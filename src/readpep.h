@@ -11,4 +11,11 @@
 
 Net* read_pep_net(char *PEPfilename);
 
+/* The same, tokenizing the blocks of the file and attaching the arcs on
+   several threads. The net is identical to the one read_pep_net builds. */
+Net* read_pep_net_parallel(char *PEPfilename, int threads);
+
+/* The same from a PEP file held in memory. */
+Net* read_pep_buffer(const char *data, size_t size);
+
 #endif /* READPEP_H_ */
@@ -0,0 +1,235 @@
+#include "unf.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+
+#define SNAPSHOT_MAGIC "AUNFSNAP1"
+
+template <class T> static bool byId(const T *a, const T *b)
+{
+    return a->id < b->id;
+}
+
+/* Places or transitions in the order of their ids, with their position. */
+template <class T> static void number(const set<T *> &nodes, vector<T *> &v,
+                                      map<T *, uint> &index)
+{
+    v.assign(nodes.begin(), nodes.end());
+    sort(v.begin(), v.end(), byId<T>);
+    for (uint i = 0; i < v.size(); i++)
+        index[v[i]] = i;
+}
+
+/* The names of the places around t, which identify it across two nets. */
+static string signature(const Trans *t)
+{
+    const list<Place *> *arcs[] = { &t->pre, &t->post, &t->read };
+    string sig;
+    for (uint i = 0; i < 3; i++) {
+        vector<string> names;
+        for (list<Place *>::const_iterator p = arcs[i]->begin(); p != arcs[i]->end(); p++)
+            names.push_back((*p)->name);
+        sort(names.begin(), names.end());
+        for (uint j = 0; j < names.size(); j++)
+            sig += names[j] + '\n';
+        sig += '\n';
+    }
+    return sig;
+}
+
+/* The file lists the names of the places and transitions, then every
+   history but h0 in order of creation: its transition, whether it was a
+   cutoff, and its enriched conditions as (history, place) pairs. Names
+   take a line each; histories are referred to by their position. */
+void Unfolder::save(ostream &out) const
+{
+    vector<Place *> places;
+    vector<Trans *> trans;
+    map<Place *, uint> pi;
+    map<Trans *, uint> ti;
+    map<Hist *, uint> hi;
+    number(net->places, places, pi);
+    number(net->transitions, trans, ti);
+
+    out << SNAPSHOT_MAGIC << "\n" << places.size() << "\n";
+    for (uint i = 0; i < places.size(); i++)
+        out << places[i]->name << "\n";
+    out << trans.size() << "\n";
+    for (uint i = 0; i < trans.size(); i++)
+        out << trans[i]->name << "\n";
+
+    out << hists.size() - 1 << "\n";
+    hi[hists[0]] = 0;
+    for (uint i = 1; i < hists.size(); i++) {
+        Hist *h = hists[i];
+        hi[h] = i;
+        /* In the order of creation, not of the addresses in the coset,
+           so that the same prefix always gives the same file. */
+        vector<EnrichedCond *> pred(h->pred.begin(), h->pred.end());
+        sort(pred.begin(), pred.end(), byId<EnrichedCond>);
+        out << ti[h->event->origin] << " " << h->cutoff << " " << pred.size();
+        for (uint j = 0; j < pred.size(); j++)
+            out << " " << hi[pred[j]->h] << " " << pi[pred[j]->c->origin];
+        out << "\n";
+    }
+}
+
+static void readNames(istream &in, vector<string> &names)
+{
+    uint n;
+    string line;
+    in >> n;
+    getline(in, line);
+    names.resize(n);
+    for (uint i = 0; i < n; i++)
+        getline(in, names[i]);
+}
+
+/* The enriched condition of h on the condition for place name, if any. */
+static EnrichedCond *findEC(Hist *h, const string &name)
+{
+    list<Cond *> conds(h->event->post);
+    conds.insert(conds.end(), h->event->read.begin(), h->event->read.end());
+    for (list<Cond *>::iterator c = conds.begin(); c != conds.end(); c++) {
+        if ((*c)->origin->name != name)
+            continue;
+        for (list<EnrichedCond *>::iterator ec = (*c)->ecs.begin(); ec != (*c)->ecs.end(); ec++)
+            if ((*ec)->h == h)
+                return *ec;
+    }
+    return 0;
+}
+
+/* Unfold net, which differs from old by a few edits, reusing the prefix of
+   old saved in the snapshot. Transitions are matched by name and count as
+   changed when the names of the places around them differ. The histories
+   of the snapshot that only use unchanged transitions are built again in
+   their original order, without searching for extensions, and only the
+   new and changed transitions are tried on their enriched conditions.
+   Possible extensions found that way are taken from the queue as soon as
+   they are smaller than the next history of the snapshot, as unfolding
+   from scratch would take them, so that they make the later histories
+   cutoffs. From the first of them on, and for histories that are no longer
+   cutoffs, every transition is tried. A change in the initial marking
+   touches every history, so the net is unfolded from scratch. */
+void Unfolder::resume(Net *old, istream &in)
+{
+    map<string, Place *> oldPlaces;
+    map<string, Trans *> oldTrans;
+    for (set<Place *>::iterator p = old->places.begin(); p != old->places.end(); p++)
+        oldPlaces[(*p)->name] = *p;
+    for (set<Trans *>::iterator t = old->transitions.begin(); t != old->transitions.end(); t++)
+        oldTrans[(*t)->name] = *t;
+
+    bool remark = false;
+    uint marked = 0;
+    for (set<Place *>::iterator p = net->places.begin(); p != net->places.end(); p++) {
+        map<string, Place *>::iterator o = oldPlaces.find((*p)->name);
+        uchar mark = o == oldPlaces.end()? 0 : o->second->mark;
+        if (mark != (*p)->mark)
+            remark = true;
+        marked += mark;
+    }
+    for (set<Place *>::iterator p = old->places.begin(); p != old->places.end(); p++)
+        marked -= (*p)->mark;
+    if (remark || marked) {
+        cerr << "initial marking changed, unfolding from scratch\n";
+        unfold();
+        return;
+    }
+
+    map<string, Trans *> kept;
+    BitVector changed;
+    for (set<Trans *>::iterator t = net->transitions.begin(); t != net->transitions.end(); t++) {
+        map<string, Trans *>::iterator o = oldTrans.find((*t)->name);
+        if (o == oldTrans.end() || signature(o->second) != signature(*t))
+            changed.set((*t)->id);
+        else
+            kept[(*t)->name] = *t;
+    }
+
+    string magic;
+    vector<string> places, trans;
+    getline(in, magic);
+    if (magic != SNAPSHOT_MAGIC) {
+        cerr << "not a snapshot file\n";
+        exit(1);
+    }
+    readNames(in, places);
+    readNames(in, trans);
+
+    list<EnrichedCond *> initial;
+    Hist *h0 = start(initial);
+    if (reached(h0))
+        return;
+    for (list<EnrichedCond *>::iterator it = initial.begin(); it != initial.end(); it++)
+        extend(*it, &changed);
+
+    uint n;
+    in >> n;
+    vector<Hist *> table(n + 1, (Hist *) 0);
+    table[0] = h0;
+    bool mixed = false;     /* a history not from the snapshot was added */
+    for (uint i = 1; i <= n && !witness && !cancelled; i++) {
+        uint t, cutoff, k;
+        in >> t >> cutoff >> k;
+        if (!in || t >= trans.size()) {
+            cerr << "snapshot file is corrupt\n";
+            exit(1);
+        }
+        map<string, Trans *>::iterator tt = kept.find(trans[t]);
+        PossExt pe;
+        pe.t = tt == kept.end()? 0 : tt->second;
+        for (uint j = 0; j < k; j++) {
+            uint h, p;
+            in >> h >> p;
+            if (!in || h >= i || p >= places.size()) {
+                cerr << "snapshot file is corrupt\n";
+                exit(1);
+            }
+            EnrichedCond *ec = pe.t && table[h]? findEC(table[h], places[p]) : 0;
+            if (!ec) {
+                pe.t = 0;
+                continue;
+            }
+            Place *q = ec->c->origin;
+            if (std::find(pe.t->pre.begin(), pe.t->pre.end(), q) != pe.t->pre.end())
+                pe.pre.push_back(ec->c);
+            else
+                pe.read.push_back(ec->c);
+            pe.pred.insert(ec);
+            pe.events |= ec->h->events;
+            pe.conflict |= ec->h->conflict;
+        }
+        if (!pe.t)
+            continue;
+        pe.size = pe.events.count();
+        pe.estimate = 0;
+
+        while (!witness && !queue.empty() && queue.top()->size < pe.size) {
+            PossExt *next = queue.top();
+            queue.pop();
+            if (addHist(next))
+                mixed = true;
+            drop(next);
+        }
+        if (witness)
+            break;
+
+        pe.seq = seq++;
+        replaying = true;
+        Hist *h = table[i] = addHist(&pe);
+        replaying = false;
+        if (!h)
+            continue;
+        if (!h->cutoff && !witness) {
+            list<EnrichedCond *> added;
+            enrich(h, added);
+            for (list<EnrichedCond *>::iterator it = added.begin(); it != added.end(); it++)
+                extend(*it, mixed || cutoff? 0 : &changed);
+        }
+        release(h);
+    }
+    run();
+}
@@ -0,0 +1,281 @@
+#include "symmetry.h"
+
+#include <algorithm>
+#include <set>
+
+/* Number of leaves tried for each candidate image of a vertex. */
+#define SEARCH_BUDGET 64
+/* Markings of an orbit enumerated to find the smallest. */
+#define MAX_ORBIT 4096
+
+typedef unsigned long long sigword;
+
+template <class T> static bool byId(const T *a, const T *b)
+{
+    return a->id < b->id;
+}
+
+/* Markings compared as numbers, trailing zero words ignored. */
+static bool smaller(const BitVector &a, const BitVector &b)
+{
+    uint n = a.words.size() > b.words.size()? a.words.size() : b.words.size();
+    for (uint i = n; i-- > 0; ) {
+        BitVector::word x = i < a.words.size()? a.words[i] : 0;
+        BitVector::word y = i < b.words.size()? b.words[i] : 0;
+        if (x != y)
+            return x < y;
+    }
+    return false;
+}
+
+static uint root(vector<uint> &uf, uint v)
+{
+    while (uf[v] != v)
+        v = uf[v] = uf[uf[v]];
+    return v;
+}
+
+struct BySig {
+    const vector<vector<sigword> > &sig;
+    BySig(const vector<vector<sigword> > &sig): sig(sig) {}
+    bool operator()(uint a, uint b) const { return sig[a] < sig[b]; }
+};
+
+/* Split colour classes by the colours of their neighbours until the
+   partition is stable. New colours are ranks of the signatures, so they do
+   not depend on vertex numbers. Returns the number of colours. */
+uint Symmetry::refine(Colouring &col) const
+{
+    uint n = col.size(), colours = 0;
+    vector<vector<sigword> > sig(n);
+    vector<uint> idx(n);
+    for (;;) {
+        for (uint v = 0; v < n; v++) {
+            sig[v].assign(1, col[v]);
+            for (uint i = 0; i < adj[v].size(); i++)
+                sig[v].push_back((sigword) adj[v][i].first << 32 | col[adj[v][i].second]);
+            sort(sig[v].begin() + 1, sig[v].end());
+            idx[v] = v;
+        }
+        sort(idx.begin(), idx.end(), BySig(sig));
+        uint c = 0;
+        for (uint i = 0; i < n; i++) {
+            if (i && sig[idx[i]] != sig[idx[i - 1]])
+                c++;
+            col[idx[i]] = c;
+        }
+        if (c + 1 == colours)
+            return colours;
+        colours = c + 1;
+    }
+}
+
+/* The smallest colour with more than one vertex, and its first vertex;
+   returns the number of vertices if the colouring is discrete. */
+uint Symmetry::cell(const Colouring &col, uint &first) const
+{
+    vector<uint> size(col.size(), 0), low(col.size(), col.size());
+    for (uint v = 0; v < col.size(); v++) {
+        size[col[v]]++;
+        if (low[col[v]] == col.size())
+            low[col[v]] = v;
+    }
+    for (uint c = 0; c < col.size(); c++)
+        if (size[c] > 1) {
+            first = low[c];
+            return c;
+        }
+    return col.size();
+}
+
+/* Whether g, a permutation of the vertices, is an automorphism. */
+bool Symmetry::check(const vector<uint> &g) const
+{
+    uint np = places.size();
+    for (uint v = 0; v < np; v++) {
+        if (g[v] >= np || places[g[v]]->mark != places[v]->mark)
+            return false;
+        if (fixed.test(places[v]->id) && g[v] != v)
+            return false;
+    }
+    for (uint j = 0; j < trans.size(); j++) {
+        if (g[np + j] < np)
+            return false;
+        Trans *t = trans[j], *u = trans[g[np + j] - np];
+        const list<Place *> *a[] = { &t->pre, &t->post, &t->read };
+        const list<Place *> *b[] = { &u->pre, &u->post, &u->read };
+        for (uint k = 0; k < 3; k++) {
+            vector<uint> x, y;
+            for (list<Place *>::const_iterator p = a[k]->begin(); p != a[k]->end(); p++)
+                x.push_back(g[index[(*p)->id]]);
+            for (list<Place *>::const_iterator p = b[k]->begin(); p != b[k]->end(); p++)
+                y.push_back(index[(*p)->id]);
+            sort(x.begin(), x.end());
+            sort(y.begin(), y.end());
+            if (x != y)
+                return false;
+        }
+    }
+    return true;
+}
+
+/* Keep the automorphism g as a generator, restricted to places. */
+void Symmetry::keep(const vector<uint> &g)
+{
+    vector<uint> perm(index.size());
+    for (uint i = 0; i < perm.size(); i++)
+        perm[i] = i;
+    for (uint v = 0; v < places.size(); v++)
+        perm[places[v]->id] = places[g[v]]->id;
+    perms.push_back(perm);
+}
+
+/* Go down from col by individualizing vertices until the colouring is
+   discrete, and compare with the first leaf. Other choices are tried until
+   the budget runs out. */
+bool Symmetry::search(Colouring col, uint colours, vector<uint> &g, uint &budget) const
+{
+    uint first;
+    uint k = cell(col, first);
+    if (k == col.size()) {
+        vector<uint> at(col.size());
+        for (uint v = 0; v < col.size(); v++)
+            at[col[v]] = v;
+        for (uint v = 0; v < col.size(); v++)
+            g[v] = at[leaf0[v]];
+        return check(g);
+    }
+    for (uint u = first; u < col.size(); u++) {
+        if (col[u] != k)
+            continue;
+        if (!budget)
+            return false;
+        budget--;
+        Colouring c(col);
+        c[u] = colours;
+        if (search(c, refine(c), g, budget))
+            return true;
+    }
+    return false;
+}
+
+void Symmetry::find(Net *net, const BitVector &fixed)
+{
+    this->fixed = fixed;
+    places.assign(net->places.begin(), net->places.end());
+    trans.assign(net->transitions.begin(), net->transitions.end());
+    sort(places.begin(), places.end(), byId<Place>);
+    sort(trans.begin(), trans.end(), byId<Trans>);
+    uint np = places.size(), n = np + trans.size();
+
+    index.clear();
+    for (uint v = 0; v < np; v++) {
+        if (places[v]->id >= index.size())
+            index.resize(places[v]->id + 1, 0);
+        index[places[v]->id] = v;
+    }
+
+    /* Arc labels, seen from the place and from the transition. */
+    adj.assign(n, vector<pair<uint, uint> >());
+    for (uint j = 0; j < trans.size(); j++) {
+        const list<Place *> *arcs[] = { &trans[j]->pre, &trans[j]->post, &trans[j]->read };
+        for (uint k = 0; k < 3; k++)
+            for (list<Place *>::const_iterator p = arcs[k]->begin(); p != arcs[k]->end(); p++) {
+                uint v = index[(*p)->id];
+                adj[v].push_back(make_pair(k, np + j));
+                adj[np + j].push_back(make_pair(3 + k, v));
+            }
+    }
+
+    /* Places by marking, then transitions; fixed places alone. */
+    Colouring col(n);
+    uint lone = 3;
+    for (uint v = 0; v < np; v++)
+        col[v] = fixed.test(places[v]->id)? lone++ : places[v]->mark;
+    for (uint v = np; v < n; v++)
+        col[v] = 2;
+    uint colours = refine(col);
+
+    /* The first path down to a leaf. */
+    vector<Colouring> levels;
+    vector<uint> chosen;
+    for (;;) {
+        uint first;
+        if (cell(col, first) == n)
+            break;
+        levels.push_back(col);
+        chosen.push_back(first);
+        col[first] = colours;
+        colours = refine(col);
+    }
+    leaf0 = col;
+
+    /* Images of the chosen vertex at each level, deepest first, so that the
+       generators found so far fix all vertices chosen above. */
+    vector<uint> uf(n), g(n);
+    for (uint v = 0; v < n; v++)
+        uf[v] = v;
+    for (uint i = levels.size(); i-- > 0; ) {
+        const Colouring &c = levels[i];
+        uint v = chosen[i];
+        for (uint u = v + 1; u < n; u++) {
+            if (c[u] != c[v] || root(uf, u) == root(uf, v))
+                continue;
+            Colouring d(c);
+            uint budget = SEARCH_BUDGET;
+            d[u] = *max_element(c.begin(), c.end()) + 1;
+            if (!search(d, refine(d), g, budget))
+                continue;
+            keep(g);
+            for (uint w = 0; w < n; w++)
+                uf[root(uf, w)] = root(uf, g[w]);
+        }
+    }
+
+    vector<uint> number(n, n);
+    uint orbits = 0;
+    orbit.clear();
+    for (uint j = 0; j < trans.size(); j++) {
+        uint r = root(uf, np + j);
+        if (number[r] == n)
+            number[r] = orbits++;
+        if (trans[j]->id >= orbit.size())
+            orbit.resize(trans[j]->id + 1, 0);
+        orbit[trans[j]->id] = number[r];
+    }
+}
+
+static void apply(const vector<uint> &perm, const BitVector &m, BitVector &out)
+{
+    out = BitVector();
+    for (int i = m.next(0); i >= 0; i = m.next(i + 1))
+        out.set(perm[i]);
+}
+
+struct Smaller {
+    bool operator()(const BitVector &a, const BitVector &b) const { return smaller(a, b); }
+};
+
+/* Replace a marking by the smallest marking of its orbit under the group
+   the generators span, so that symmetric markings get the same one. The
+   orbit is closed under the generators breadth first. Orbits of more than
+   MAX_ORBIT markings are cut short; the smallest marking seen is then
+   not always the same for symmetric markings, which only costs cutoffs. */
+void Symmetry::canonical(BitVector &marking) const
+{
+    if (perms.empty())
+        return;
+    set<BitVector, Smaller> seen;
+    vector<BitVector> orbit(1, marking);
+    seen.insert(marking);
+    BitVector img;
+    for (uint i = 0; i < orbit.size() && orbit.size() < MAX_ORBIT; i++)
+        for (uint k = 0; k < perms.size(); k++) {
+            apply(perms[k], orbit[i], img);
+            if (seen.insert(img).second) {
+                if (smaller(img, marking))
+                    marking = img;
+                orbit.push_back(img);
+            }
+        }
+}
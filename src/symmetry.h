@@ -0,0 +1,42 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include "net.h"
+
+#include <vector>
+
+/* Automorphisms of a net: permutations of its places and transitions that
+   map arcs to arcs of the same kind and keep the initial marking. They are
+   found as generators of the group by individualization and refinement of
+   a colouring of the net graph, and every candidate is checked before it is
+   kept. Places given as fixed are only mapped to themselves. */
+class Symmetry {
+public:
+    void find(Net *net, const BitVector &fixed);
+    void canonical(BitVector &marking) const;
+    uint generators() const { return perms.size(); }
+
+    /* Orbits of transitions under the group, numbered from 0 in the order
+       of their smallest transition id; indexed by transition id. */
+    const vector<uint> &orbits() const { return orbit; }
+
+private:
+    typedef vector<uint> Colouring;
+
+    vector<Place *> places;   /* vertices 0 to places.size() - 1 */
+    vector<Trans *> trans;    /* the vertices after them */
+    vector<uint> index;       /* vertex of each place id */
+    BitVector fixed;
+    vector<vector<pair<uint, uint> > > adj;   /* (arc label, vertex) */
+    Colouring leaf0;
+    vector<vector<uint> > perms;              /* generators, on place ids */
+    vector<uint> orbit;
+
+    uint refine(Colouring &col) const;
+    uint cell(const Colouring &col, uint &first) const;
+    bool search(Colouring col, uint colours, vector<uint> &g, uint &budget) const;
+    bool check(const vector<uint> &g) const;
+    void keep(const vector<uint> &g);
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "trace.h"
+
+#ifdef AUNF_TRACE
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <pthread.h>
+#include <time.h>
+
+using namespace std;
+
+/* Spans kept per thread unless AUNF_TRACE_RING says otherwise; older
+   ones are overwritten. A record takes 24 bytes. */
+#define TRACE_RING (1 << 16)
+
+struct TraceRecord {
+    const char *name;
+    unsigned long long begin, end;
+};
+
+/* Only the owning thread writes to a buffer, so recording takes no lock.
+   The buffers are read once all other threads are done, at exit. */
+struct TraceBuffer {
+    unsigned tid;
+    unsigned long long count;
+    TraceRecord *records;
+};
+
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static vector<TraceBuffer *> traceBuffers;
+static unsigned long long traceStart;
+static unsigned long long traceMask;    /* ring size - 1, a power of two */
+static __thread TraceBuffer *traceLocal;
+
+static unsigned long long traceClock()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void traceDump()
+{
+    const char *file = getenv("AUNF_TRACE_FILE");
+    FILE *out = fopen(file? file : "aunf-trace.json", "w");
+    if (!out)
+        return;
+    fprintf(out, "{\"traceEvents\":[\n");
+    const char *sep = "";
+    pthread_mutex_lock(&traceLock);
+    for (unsigned i = 0; i < traceBuffers.size(); i++) {
+        TraceBuffer *b = traceBuffers[i];
+        unsigned long long first = b->count > traceMask? b->count - traceMask - 1 : 0;
+        for (unsigned long long k = first; k < b->count; k++) {
+            const TraceRecord &r = b->records[k & traceMask];
+            fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f}", sep, r.name, b->tid,
+                    (r.begin - traceStart) / 1000.0, (r.end - r.begin) / 1000.0);
+            sep = ",\n";
+        }
+    }
+    pthread_mutex_unlock(&traceLock);
+    fprintf(out, "\n]}\n");
+    fclose(out);
+}
+
+/* Buffers are never freed, so that the spans of threads that have ended
+   are still there at exit. */
+static TraceBuffer *traceBuffer()
+{
+    TraceBuffer *b = new TraceBuffer();
+    b->count = 0;
+    pthread_mutex_lock(&traceLock);
+    if (traceBuffers.empty()) {
+        const char *size = getenv("AUNF_TRACE_RING");
+        unsigned long long n = size? strtoull(size, 0, 10) : TRACE_RING;
+        for (traceMask = 1; traceMask < n; traceMask <<= 1)
+            ;
+        traceMask--;
+        traceStart = traceClock();
+        atexit(traceDump);
+    }
+    b->records = new TraceRecord[traceMask + 1];
+    b->tid = traceBuffers.size();
+    traceBuffers.push_back(b);
+    pthread_mutex_unlock(&traceLock);
+    return traceLocal = b;
+}
+
+TraceSpan::TraceSpan(const char *name): name(name)
+{
+    if (!traceLocal)
+        traceBuffer();
+    begin = traceClock();
+}
+
+TraceSpan::~TraceSpan()
+{
+    TraceBuffer *b = traceLocal;
+    TraceRecord &r = b->records[b->count & traceMask];
+    r.name = name;
+    r.begin = begin;
+    r.end = traceClock();
+    b->count++;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Scoped spans for profiling, compiled in when AUNF_TRACE is defined (the
+   AUNF_TRACE cmake option). TRACE_SPAN("name") records the time from where
+   it stands to the end of the enclosing block. Every thread writes to its
+   own ring buffer, which keeps the latest spans, and the buffers are
+   written as a Chrome trace (chrome://tracing, Perfetto) to the file named
+   by AUNF_TRACE_FILE, aunf-trace.json by default, when the program exits.
+   AUNF_TRACE_RING sets the number of spans a buffer keeps, 65536 by
+   default (1.5 MB per thread that records any).
+   Without AUNF_TRACE the macro expands to nothing. The name must be a
+   string that lives until then, usually a literal. */
+
+#ifdef AUNF_TRACE
+
+class TraceSpan {
+public:
+    TraceSpan(const char *name);
+    ~TraceSpan();
+
+private:
+    const char *name;
+    unsigned long long begin;
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_JOIN(trace_span_, __LINE__)(name)
+
+#else
+
+#define TRACE_SPAN(name)
+
+#endif
+
+#endif
@@ -1,6 +1,651 @@
 #include "unf.h"
+#include "workers.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <ctime>
+
+#define MEM_REPORT_SECONDS 10
+#define PROGRESS_STEPS 1024
+
+Hist *MarkingTable::find(const BitVector &key) const
+{
+    const list<Entry> &b = buckets[key.hash() % buckets.size()];
+    for (list<Entry>::const_iterator it = b.begin(); it != b.end(); it++)
+        if (it->first == key)
+            return it->second;
+    return 0;
+}
+
+void MarkingTable::insert(const BitVector &key, Hist *h)
+{
+    if (++count > buckets.size()) {
+        vector<list<Entry> > old(buckets.size() * 2);
+        old.swap(buckets);
+        for (uint i = 0; i < old.size(); i++)
+            for (list<Entry>::iterator it = old[i].begin(); it != old[i].end(); it++)
+                buckets[it->first.hash() % buckets.size()].push_back(*it);
+    }
+    buckets[key.hash() % buckets.size()].push_back(make_pair(key, h));
+}
+
+void MarkingTable::replace(const BitVector &key, Hist *h)
+{
+    list<Entry> &b = buckets[key.hash() % buckets.size()];
+    for (list<Entry>::iterator it = b.begin(); it != b.end(); it++)
+        if (it->first == key)
+            it->second = h;
+}
+
+size_t MarkingTable::memory() const
+{
+    size_t n = buckets.capacity() * sizeof(list<Entry>);
+    for (uint i = 0; i < buckets.size(); i++)
+        for (list<Entry>::const_iterator it = buckets[i].begin(); it != buckets[i].end(); it++)
+            n += sizeof(Entry) + 2 * sizeof(void *) + it->first.memory();
+    return n;
+}
+
+static size_t histBytes(const Hist *h)
+{
+    return sizeof(Hist) + h->events.memory() + h->conflict.memory()
+         + h->marking.memory() + h->order.capacity() * sizeof(uint);
+}
+
+static size_t extBytes(const PossExt *pe)
+{
+    return sizeof(PossExt) + pe->events.memory() + pe->conflict.memory()
+         + (pe->pre.capacity() + pe->read.capacity()) * sizeof(Cond *)
+         + pe->parikh.capacity() * sizeof(uint);
+}
+
+/* Nodes of the lists of an event or a condition. */
+template <class T> static size_t nodeBytes(const Node<T> *n)
+{
+    return (n->pre.size() + n->post.size() + n->read.size()) * (sizeof(T *) + 2 * sizeof(void *));
+}
+
+static bool placeOrder(const Place *a, const Place *b)
+{
+    return a->id < b->id;
+}
+
+/* For every target place, a lower bound on the number of transitions to
+   fire before it gets a token, starting from a token on each place:
+   backwards breadth-first search through producers and their pre- and
+   context places. Places that cannot lead to it get the number of places. */
+void Unfolder::distances()
+{
+    uint n = 0;
+    for (set<Place *>::iterator p = net->places.begin(); p != net->places.end(); p++)
+        if ((*p)->id >= n) n = (*p)->id + 1;
+
+    for (set<Place *>::iterator q = net->places.begin(); q != net->places.end(); q++) {
+        if (!target.test((*q)->id))
+            continue;
+        vector<uint> d(n, net->places.size());
+        list<Place *> todo(1, *q);
+        d[(*q)->id] = 0;
+        while (!todo.empty()) {
+            Place *p = todo.front();
+            todo.pop_front();
+            for (list<Trans *>::iterator t = p->pre.begin(); t != p->pre.end(); t++) {
+                list<Place *> from((*t)->pre);
+                from.insert(from.end(), (*t)->read.begin(), (*t)->read.end());
+                for (list<Place *>::iterator r = from.begin(); r != from.end(); r++)
+                    if (d[(*r)->id] > d[p->id] + 1) {
+                        d[(*r)->id] = d[p->id] + 1;
+                        todo.push_back(*r);
+                    }
+            }
+        }
+        distance.push_back(d);
+    }
+}
+
+/* The farthest target place, each measured from its closest marked place. */
+uint Unfolder::estimate(const BitVector &marking) const
+{
+    uint est = 0;
+    for (uint k = 0; k < distance.size(); k++) {
+        uint best = net->places.size();
+        for (int i = marking.next(0); i >= 0 && best; i = marking.next(i + 1))
+            if (distance[k][i] < best)
+                best = distance[k][i];
+        if (best > est)
+            est = best;
+    }
+    return est;
+}
+
+/* Create the root event, its history and the initial conditions. */
+Hist *Unfolder::start(list<EnrichedCond *> &initial)
+{
+    unf = new Unf();
+    order = new AsymOrder(unf);
+    if (directed)
+        distances();
+
+    Event *root = unf->root = new Event();
+    root->id = 0;
+    root->origin = 0;
+    unf->events.push_back(root);
+
+    Hist *h0 = new Hist();
+    h0->event = root;
+    h0->size = 0;
+    h0->cutoff = false;
+    h0->events.set(0);
+    h0->order.push_back(0);
+    root->hist.push_back(h0);
+    hists.push_back(h0);
+    memAdd(MEM_HISTORIES, histBytes(h0));
+
+    vector<Place *> places(net->places.begin(), net->places.end());
+    sort(places.begin(), places.end(), placeOrder);
+    for (vector<Place *>::iterator p = places.begin(); p != places.end(); p++) {
+        if (!(*p)->mark)
+            continue;
+        Cond *c = new Cond();
+        c->id = unf->conditions.size();
+        c->name = (*p)->name;
+        c->origin = *p;
+        c->pre.push_back(root);
+        root->post.push_back(c);
+        (*p)->image.push_back(c);
+        unf->conditions.push_back(c);
+        h0->marking.set((*p)->id);
+        memAdd(MEM_EVENTS, sizeof(Cond));
+
+        EnrichedCond *ec = new EnrichedCond(ecs++, c, h0);
+        c->ecs.push_back(ec);
+        initial.push_back(ec);
+    }
+    markings.insert(key(h0->marking), h0);
+    return h0;
+}
 
 void Unfolder::unfold()
 {
+    list<EnrichedCond *> initial;
+    if (reached(start(initial)))
+        return;
+
+    if (workers) {
+        spawn(initial);
+        run();
+        halt();
+        return;
+    }
+    for (list<EnrichedCond *>::iterator it = initial.begin(); it != initial.end(); it++)
+        extend(*it);
+    run();
+}
 
+void Unfolder::run()
+{
+    time_t last = time(0);
+    for (uint step = 0; !witness && !cancelled && (pool? gather() : !queue.empty()); step++) {
+        TRACE_SPAN("step");
+        publish();
+        if (listener && step % PROGRESS_STEPS == 0)
+            listener->progress(this);
+        if (memstats && step % 1024 == 0 && time(0) - last >= MEM_REPORT_SECONDS) {
+            last = time(0);
+            cerr << "Histories: " << histories << endl;
+            memoryReport(cerr);
+        }
+        PossExt *pe = queue.top();
+        queue.pop();
+        addHist(pe);
+        drop(pe);
+    }
+    publish();
+}
+
+void Unfolder::push(PossExt *pe)
+{
+    pe->seq = seq++;
+    if (symmetry)
+        parikh(pe->events, pe->t, pe->parikh);
+    queue.push(pe);
+    memAdd(MEM_QUEUE, extBytes(pe));
+}
+
+void Unfolder::drop(PossExt *pe)
+{
+    memSub(MEM_QUEUE, extBytes(pe));
+    delete pe;
+}
+
+void Unfolder::publish()
+{
+    size_t memory = 0;
+    for (int c = 0; c < MEM_COUNTED; c++)
+        memory += memCounters[c].live;
+    __atomic_store_n(&counters.events, (uint) unf->events.size() - 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&counters.conditions, (uint) unf->conditions.size(), __ATOMIC_RELAXED);
+    __atomic_store_n(&counters.histories, histories, __ATOMIC_RELAXED);
+    __atomic_store_n(&counters.cutoffs, cutoffs, __ATOMIC_RELAXED);
+    __atomic_store_n(&counters.queue, (uint) queue.size(), __ATOMIC_RELAXED);
+    __atomic_store_n(&counters.memory, memory, __ATOMIC_RELAXED);
+}
+
+/* The counted structures, and those measured here: names, which are never
+   freed, and the marking table, which only grows. */
+void Unfolder::memoryReport(ostream &out) const
+{
+    const char *names[] = { "names", "marking table" };
+    size_t bytes[] = { 0, markings.memory() };
+    for (set<Place *>::const_iterator p = net->places.begin(); p != net->places.end(); p++)
+        bytes[0] += (*p)->name.capacity();
+    for (set<Trans *>::const_iterator t = net->transitions.begin(); t != net->transitions.end(); t++)
+        bytes[0] += (*t)->name.capacity();
+    if (unf) {
+        for (uint i = 0; i < unf->conditions.size(); i++)
+            bytes[0] += unf->conditions[i]->name.capacity();
+        for (uint i = 0; i < unf->events.size(); i++)
+            bytes[0] += unf->events[i]->name.capacity();
+    }
+    memReport(out, names, bytes, 2);
+}
+
+/* What cutoffs compare markings by: the marking itself, or with symmetry
+   reduction a representative of its orbit. */
+BitVector Unfolder::key(const BitVector &marking) const
+{
+    BitVector k(marking);
+    if (symmetry)
+        symmetry->canonical(k);
+    return k;
+}
+
+/* The events of a history, or of the history t would get after events,
+   as the sorted orbits of their transitions followed by their sorted
+   transitions. Of two such lists for histories of the same size, the one
+   that is greater where they first differ has fewer events of the orbit
+   or transition there, and comes first in the order of the cutoffs. */
+void Unfolder::parikh(const BitVector &events, const Trans *t, vector<uint> &key) const
+{
+    const vector<uint> &orbit = symmetry->orbits();
+    vector<uint> trans;
+    if (t)
+        trans.push_back(t->id);
+    for (int i = events.next(1); i >= 0; i = events.next(i + 1))
+        trans.push_back(unf->events[i]->origin->id);
+    key.resize(trans.size());
+    for (uint i = 0; i < trans.size(); i++)
+        key[i] = orbit[trans[i]];
+    sort(key.begin(), key.end());
+    sort(trans.begin(), trans.end());
+    key.insert(key.end(), trans.begin(), trans.end());
+}
+
+/* The adequate order of the cutoffs. Histories are compared by size, and
+   with symmetry reduction equal sizes by their numbers of events of each
+   orbit of transitions, lexicographically: these are the same for a
+   history and its images, and adding the same extension to two histories
+   keeps them apart, so the order stays adequate up to symmetry. Histories
+   with the very same marking are then compared by their numbers of events
+   of each transition. Histories that only differ by a symmetry stay
+   unordered. */
+bool Unfolder::before(const Hist *a, const Hist *b) const
+{
+    if (a->size != b->size || !symmetry)
+        return a->size < b->size;
+    vector<uint> ka, kb;
+    parikh(a->events, 0, ka);
+    parikh(b->events, 0, kb);
+    vector<uint>::iterator ma = ka.begin() + ka.size() / 2, mb = kb.begin() + kb.size() / 2;
+    if (!std::equal(ka.begin(), ma, kb.begin()))
+        return lexicographical_compare(kb.begin(), mb, ka.begin(), ma);
+    if (!(a->marking == b->marking))
+        return false;
+    return lexicographical_compare(mb, kb.end(), ma, ka.end());
+}
+
+bool Unfolder::reached(Hist *h)
+{
+    if (target.count() && h->marking.includes(target))
+        witness = h;
+    return witness != 0;
+}
+
+/* Places marked after the chosen histories, once t has taken its
+   preconditions. */
+BitVector Unfolder::marking(const PossExt &pe) const
+{
+    BitVector marking;
+    for (int i = pe.events.next(0); i >= 0; i = pe.events.next(i + 1)) {
+        Event *e = unf->events[i];
+        for (list<Cond *>::iterator c = e->post.begin(); c != e->post.end(); c++)
+            if (!unf->consumed(*c, pe.events))
+                marking.set((*c)->origin->id);
+    }
+    for (vector<Cond *>::const_iterator c = pe.pre.begin(); c != pe.pre.end(); c++)
+        marking.reset((*c)->origin->id);
+    return marking;
+}
+
+/* Turn a possible extension into a history, creating its event and
+   postconditions if the event is new. Returns 0 if the history exists.
+   known is the marking of the history, if it was computed before. */
+Hist *Unfolder::addHist(PossExt *pe, const BitVector *known)
+{
+    Trans *t = pe->t;
+
+    BitVector marking;
+    if (known)
+        marking = *known;
+    else {
+        marking = this->marking(*pe);
+        for (list<Place *>::iterator p = t->post.begin(); p != t->post.end(); p++) {
+            if (marking.test((*p)->id)) {
+                cerr << "net is not safe: place " << (*p)->name << " gets two tokens\n";
+                exit(1);
+            }
+            marking.set((*p)->id);
+        }
+    }
+
+    Event *e = 0;
+    for (Trans::Image::iterator it = t->image.begin(); it != t->image.end() && !e; it++) {
+        if ((*it)->pre.size() != pe->pre.size() || (*it)->read.size() != pe->read.size())
+            continue;
+        e = *it;
+        for (vector<Cond *>::iterator c = pe->pre.begin(); e && c != pe->pre.end(); c++)
+            if (std::find(e->pre.begin(), e->pre.end(), *c) == e->pre.end()) e = 0;
+        for (vector<Cond *>::iterator c = pe->read.begin(); e && c != pe->read.end(); c++)
+            if (std::find(e->read.begin(), e->read.end(), *c) == e->read.end()) e = 0;
+    }
+
+    BitVector events = pe->events;
+    if (e) {
+        /* Different choices of enriched conditions may yield the same history. */
+        events.set(e->id);
+        for (list<Hist *>::iterator h = e->hist.begin(); h != e->hist.end(); h++)
+            if ((*h)->events == events)
+                return 0;
+    } else {
+        e = new Event();
+        e->id = unf->events.size();
+        e->name = t->name;
+        e->origin = t;
+        for (vector<Cond *>::iterator c = pe->pre.begin(); c != pe->pre.end(); c++) {
+            e->pre.push_back(*c);
+            (*c)->post.push_back(e);
+        }
+        for (vector<Cond *>::iterator c = pe->read.begin(); c != pe->read.end(); c++) {
+            e->read.push_back(*c);
+            (*c)->read.push_back(e);
+        }
+        for (list<Place *>::iterator p = t->post.begin(); p != t->post.end(); p++) {
+            Cond *c = new Cond();
+            c->id = unf->conditions.size();
+            c->name = (*p)->name;
+            c->origin = *p;
+            c->pre.push_back(e);
+            e->post.push_back(c);
+            (*p)->image.push_back(c);
+            unf->conditions.push_back(c);
+        }
+        t->image.push_back(e);
+        unf->events.push_back(e);
+        unf->label(e);
+        events.set(e->id);
+        if (listener)
+            listener->eventAdded(this, e);
+        memAdd(MEM_EVENTS, sizeof(Event) + e->past.memory() + e->conflict.memory()
+                           + nodeBytes(e) + t->post.size() * sizeof(Cond));
+    }
+
+    Hist *h = new Hist();
+    h->size = pe->size;
+    h->event = e;
+    h->pred = pe->pred;
+    h->events = events;
+    h->conflict = pe->conflict;
+    h->conflict |= e->conflict;
+    h->marking = marking;
+
+    /* The coordinator of worker processes does not extend h, so it only
+       needs the order of the witness. */
+    if (!pool)
+        sequence(h);
+    memAdd(MEM_HISTORIES, histBytes(h));
+
+    /* McMillan's cutoff criterion. The queue hands out histories by
+       increasing size unless the unfolding is directed, so the recorded
+       history is replaced when a smaller one shows up late. */
+    BitVector k = key(marking);
+    Hist *other = markings.find(k);
+    h->cutoff = other && before(other, h);
+    if (h->cutoff && listener)
+        listener->cutoff(this, h, other);
+    if (!other)
+        markings.insert(k, h);
+    else if (before(h, other))
+        markings.replace(k, h);
+    e->hist.push_back(h);
+    hists.push_back(h);
+    if (pool)
+        pool->record(pe, h);
+    histories++;
+    if (h->cutoff)
+        cutoffs++;
+    if (!reached(h) && !h->cutoff && !replaying) {
+        list<EnrichedCond *> added;
+        enrich(h, added);
+        for (list<EnrichedCond *>::iterator it = added.begin(); it != added.end(); it++)
+            if (pool)
+                pool->defer(*it);
+            else
+                extend(*it);
+    }
+    if (pool && h == witness) {
+        sequence(h);
+        memAdd(MEM_HISTORIES, h->order.capacity() * sizeof(uint));
+    }
+    /* Histories replayed from a snapshot or by a worker are released by
+       the caller, once it is done with them. */
+    if (!replaying)
+        release(h);
+    return h;
+}
+
+/* Replay the union of the chosen histories to get an order for it. */
+void Unfolder::sequence(Hist *h)
+{
+    order->undo(0);
+    for (Coset_iter it = h->pred.begin(); it != h->pred.end(); it++)
+        order->add((*it)->h);
+    order->sequence(h->order);
+    order->undo(0);
+    h->order.push_back(h->event->id);
+}
+
+/* Drop the firing order of h once its enriched conditions have been tried:
+   it takes as much room as the history, and the few later users can have
+   AsymOrder build one again. The witness keeps it, to be printed. */
+void Unfolder::release(Hist *h)
+{
+    if (h == witness)
+        return;
+    memSub(MEM_HISTORIES, h->order.capacity() * sizeof(uint));
+    vector<uint>().swap(h->order);
+}
+
+/* Create the enriched conditions of a history that is no cutoff: for the
+   conditions its event produces and reads. */
+void Unfolder::enrich(Hist *h, list<EnrichedCond *> &added)
+{
+    Event *e = h->event;
+    for (list<Cond *>::iterator c = e->post.begin(); c != e->post.end(); c++) {
+        EnrichedCond *ec = new EnrichedCond(ecs++, *c, h);
+        (*c)->ecs.push_back(ec);
+        added.push_back(ec);
+    }
+    for (list<Cond *>::iterator c = e->read.begin(); c != e->read.end(); c++) {
+        EnrichedCond *ec = new EnrichedCond(ecs++, *c, h);
+        (*c)->ecs.push_back(ec);
+        added.push_back(ec);
+    }
+}
+
+/* Find the possible extensions whose most recent enriched condition is ec.
+   An enriched condition coming from a reader of its condition may only be
+   consumed; read arcs only pick enriched conditions of the producer.
+   If only is given, just the transitions with an id in it are tried. */
+void Unfolder::extend(EnrichedCond *ec, const BitVector *only)
+{
+    TRACE_SPAN("extend");
+    Place *p = ec->c->origin;
+    bool producer = ec->h->event == ec->c->pre.front();
+
+    /* Every candidate contains the history of ec; order it once so that
+       each candidate only pays for the events the others add to it. */
+    order->undo(0);
+    order->add(ec->h);
+
+    for (list<Trans *>::iterator t = p->post.begin(); t != p->post.end(); t++) {
+        if (only && !only->test((*t)->id))
+            continue;
+        Slots slots;
+        slots.push_back(make_pair(p, false));
+        for (list<Place *>::iterator q = (*t)->pre.begin(); q != (*t)->pre.end(); q++)
+            if (*q != p) slots.push_back(make_pair(*q, false));
+        for (list<Place *>::iterator q = (*t)->read.begin(); q != (*t)->read.end(); q++)
+            slots.push_back(make_pair(*q, true));
+
+        PossExt pe;
+        pe.t = *t;
+        search(pe, ec, slots, 0);
+    }
+
+    for (list<Trans *>::iterator t = p->read.begin(); producer && t != p->read.end(); t++) {
+        if (only && !only->test((*t)->id))
+            continue;
+        Slots slots;
+        slots.push_back(make_pair(p, true));
+        for (list<Place *>::iterator q = (*t)->pre.begin(); q != (*t)->pre.end(); q++)
+            slots.push_back(make_pair(*q, false));
+        for (list<Place *>::iterator q = (*t)->read.begin(); q != (*t)->read.end(); q++)
+            if (*q != p) slots.push_back(make_pair(*q, true));
+
+        PossExt pe;
+        pe.t = *t;
+        search(pe, ec, slots, 0);
+    }
+    order->undo(0);
+}
+
+/* Choose enriched conditions for slots i and following. Slot 0 always holds
+   the condition of ec; all other enriched conditions must be older than ec. */
+void Unfolder::search(PossExt &pe, EnrichedCond *ec, Slots &slots, uint i)
+{
+    if (i == slots.size()) {
+        PossExt *n = new PossExt(pe);
+        n->size = n->events.count();
+        n->estimate = 0;
+        if (directed) {
+            BitVector m = marking(*n);
+            for (list<Place *>::iterator p = n->t->post.begin(); p != n->t->post.end(); p++)
+                m.set((*p)->id);
+            n->estimate = estimate(m);
+        }
+        push(n);
+        return;
+    }
+
+    Place *q = slots[i].first;
+    bool read = slots[i].second;
+    Place::Image single;
+    if (!i) single.push_back(ec->c);
+    Place::Image &conds = i? q->image : single;
+
+    for (Place::Image::iterator c = conds.begin(); c != conds.end(); c++) {
+        if (read) {
+            pe.read.push_back(*c);
+            for (list<EnrichedCond *>::iterator r = (*c)->ecs.begin(); r != (*c)->ecs.end(); r++) {
+                if (i? (*r)->id >= ec->id || (*r)->h->event != (*c)->pre.front() : *r != ec)
+                    continue;
+                BitVector saved = pe.events, savedc = pe.conflict;
+                uint mark = order->mark();
+                pe.pred.insert(*r);
+                pe.events |= (*r)->h->events;
+                pe.conflict |= (*r)->h->conflict;
+                if (valid(pe) && order->add((*r)->h))
+                    search(pe, ec, slots, i + 1);
+                order->undo(mark);
+                pe.pred.erase(*r);
+                pe.events = saved;
+                pe.conflict = savedc;
+            }
+            pe.read.pop_back();
+        } else {
+            vector<EnrichedCond *> cand;
+            for (list<EnrichedCond *>::iterator r = (*c)->ecs.begin(); r != (*c)->ecs.end(); r++)
+                if ((*r)->id < ec->id) cand.push_back(*r);
+
+            pe.pre.push_back(*c);
+            if (i) {
+                searchPre(pe, ec, slots, i, cand, 0, false);
+            } else {
+                BitVector saved = pe.events, savedc = pe.conflict;
+                uint mark = order->mark();
+                pe.pred.insert(ec);
+                pe.events |= ec->h->events;
+                pe.conflict |= ec->h->conflict;
+                if (valid(pe) && order->add(ec->h))
+                    searchPre(pe, ec, slots, i, cand, 0, true);
+                order->undo(mark);
+                pe.pred.erase(ec);
+                pe.events = saved;
+                pe.conflict = savedc;
+            }
+            pe.pre.pop_back();
+        }
+    }
+}
+
+/* A consumed condition may come with any nonempty set of its enriched
+   conditions, i.e. with any compatible set of readers preceding it. */
+void Unfolder::searchPre(PossExt &pe, EnrichedCond *ec, Slots &slots, uint i,
+                         vector<EnrichedCond *> &cand, uint k, bool picked)
+{
+    if (k == cand.size()) {
+        if (picked)
+            search(pe, ec, slots, i + 1);
+        return;
+    }
+    searchPre(pe, ec, slots, i, cand, k + 1, picked);
+
+    BitVector saved = pe.events, savedc = pe.conflict;
+    uint mark = order->mark();
+    pe.pred.insert(cand[k]);
+    pe.events |= cand[k]->h->events;
+    pe.conflict |= cand[k]->h->conflict;
+    if (valid(pe) && order->add(cand[k]->h))
+        searchPre(pe, ec, slots, i, cand, k + 1, true);
+    order->undo(mark);
+    pe.pred.erase(cand[k]);
+    pe.events = saved;
+    pe.conflict = savedc;
+}
+
+/* The union of the chosen histories must be a configuration that leaves
+   all chosen conditions in its cut. The conflict labels rule out events
+   competing for a condition; cycles of asymmetric conflict are caught by
+   the order as the histories are added to it. */
+bool Unfolder::valid(const PossExt &pe) const
+{
+    if (pe.conflict.intersects(pe.events))
+        return false;
+    for (vector<Cond *>::const_iterator c = pe.pre.begin(); c != pe.pre.end(); c++)
+        if (unf->consumed(*c, pe.events))
+            return false;
+    for (vector<Cond *>::const_iterator c = pe.read.begin(); c != pe.read.end(); c++)
+        if (unf->consumed(*c, pe.events))
+            return false;
+    return true;
 }
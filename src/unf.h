@@ -2,13 +2,195 @@
 #define UNF_H
 
 #include "net.h"
+#include "order.h"
+#include "symmetry.h"
+
+#include <cstring>
+#include <queue>
+#include <vector>
+
+/* A possible extension: transition t fired after the union of the histories
+   of the enriched conditions in pred. */
+class PossExt {
+public:
+    Trans *t;
+    Coset pred;
+    vector<Cond *> pre;
+    vector<Cond *> read;
+    BitVector events;   /* union of the histories in pred */
+    BitVector conflict; /* union of their conflict labels */
+    uint size;          /* size of the history that t would get */
+    uint estimate;      /* events still needed to reach the target, at least */
+    uint seq;           /* order of discovery, breaks ties */
+    vector<uint> parikh;  /* with symmetry reduction, see Unfolder::parikh() */
+};
+
+/* By size plus estimate (just size unless the unfolding is directed);
+   among equals, the one closest to the target, then the first in the order
+   of the cutoffs. */
+struct PossExtOrder {
+    bool operator()(const PossExt *a, const PossExt *b) const {
+        uint fa = a->size + a->estimate, fb = b->size + b->estimate;
+        if (fa != fb)
+            return fa > fb;
+        if (a->estimate != b->estimate)
+            return a->estimate > b->estimate;
+        return a->parikh != b->parikh? a->parikh < b->parikh : a->seq > b->seq;
+    }
+};
+
+/* Histories indexed by the key of their marking; keeps the smallest one
+   per key. */
+class MarkingTable {
+public:
+    MarkingTable(): buckets(1024), count(0) {}
+
+    Hist *find(const BitVector &key) const;
+    void insert(const BitVector &key, Hist *h);
+    void replace(const BitVector &key, Hist *h);
+    size_t memory() const;
+
+private:
+    typedef pair<BitVector, Hist *> Entry;
+
+    vector<list<Entry> > buckets;
+    uint count;
+};
+
+class Unfolder;
+class WorkerPool;
+
+/* Hooks for programs that drive the unfolder themselves. eventAdded is
+   called for every new event, cutoff for every history found to be a
+   cutoff with the history that made it one, and progress every
+   PROGRESS_STEPS possible extensions taken from the queue. They run on the
+   unfolding thread. */
+class UnfoldListener {
+public:
+  virtual ~UnfoldListener() {}
+
+  virtual void eventAdded(Unfolder *, Event *) {}
+  virtual void cutoff(Unfolder *, Hist *, Hist *) {}
+  virtual void progress(Unfolder *) {}
+};
+
+/* Counters of a running unfolding. The unfolding thread stores them after
+   every step with relaxed atomic stores, so that another thread can sample
+   them (with __atomic_load_n) without any locking in the loop. */
+struct UnfoldCounters {
+  uint events, conditions, histories, cutoffs, queue;
+  size_t memory;    /* live bytes of the counted structures */
+};
+
+/* Places of a transition to be matched during the search, with a flag
+   telling whether the place is read rather than consumed. */
+typedef vector<pair<Place *, bool> > Slots;
 
 class Unfolder {
 public:
   Net *net;
   Unf *unf;
 
+  uint histories;
+  uint cutoffs;
+  uint ecs;
+
+  /* Places to be marked together. When not empty, unfolding stops at the
+     first history whose marking covers them, and witness is set to it. */
+  BitVector target;
+  Hist *witness;
+
+  /* Take possible extensions that seem closer to the target first. The
+     cutoff criterion still compares sizes, so the prefix stays complete. */
+  bool directed;
+
+  /* Automorphisms of the net; cutoffs then compare markings up to them,
+     and histories of the same size by their events per orbit of
+     transitions (before()). The prefix is complete up to symmetry. */
+  Symmetry *symmetry;
+
+  /* Print the memory report to cerr every MEM_REPORT_SECONDS while
+     unfolding. */
+  bool memstats;
+
+  UnfoldListener *listener;
+
+  /* Number of worker processes searching for possible extensions while
+     this process commits them (workers.cpp); 0 searches here. The prefix
+     is the same either way, but the order the witness is printed in may
+     differ. */
+  uint workers;
+
+  /* Set, from any thread, to stop unfolding after the current step; the
+     prefix is then incomplete. */
+  volatile bool cancelled;
+
+  UnfoldCounters counters;
+
+  Unfolder(): net(0), unf(0), histories(0), cutoffs(0), ecs(0), witness(0),
+              directed(false), symmetry(0), memstats(false), listener(0),
+              workers(0), cancelled(false), order(0), seq(0), replaying(false),
+              pool(0), unextended(0) {
+    memset(&counters, 0, sizeof(counters));
+  }
+
   void unfold();
+  void cancel() { cancelled = true; }
+
+  /* Whether unfolding was cancelled with possible extensions left. */
+  bool interrupted() const {
+    return cancelled && (!queue.empty() || unextended) && !witness;
+  }
+  void memoryReport(ostream &out) const;
+
+  /* The recorded history with the marking of h, the one that made h a
+     cutoff if it is one. */
+  Hist *corresponding(const Hist *h) const { return markings.find(key(h->marking)); }
+
+  /* Snapshots of a finished prefix, to unfold a slightly changed net again
+     (snapshot.cpp). */
+  void save(ostream &out) const;
+  void resume(Net *old, istream &in);
+
+private:
+  priority_queue<PossExt *, vector<PossExt *, CountingAllocator<PossExt *, MEM_QUEUE> >,
+                 PossExtOrder> queue;
+  MarkingTable markings;
+  AsymOrder *order;
+  uint seq;
+  vector<Hist *> hists;             /* in order of creation, h0 first */
+  bool replaying;                   /* histories come from a snapshot or the store */
+  vector<vector<uint> > distance;   /* per target place, indexed by place id */
+  WorkerPool *pool;                 /* in the coordinator of the workers */
+  uint unextended;                  /* enriched conditions left to them */
+
+  void distances();
+  uint estimate(const BitVector &marking) const;
+  BitVector marking(const PossExt &pe) const;
+  Hist *start(list<EnrichedCond *> &initial);
+  void run();
+  void publish();
+  void push(PossExt *pe);
+  void drop(PossExt *pe);
+  BitVector key(const BitVector &marking) const;
+  void parikh(const BitVector &events, const Trans *t, vector<uint> &key) const;
+  bool before(const Hist *a, const Hist *b) const;
+  bool reached(Hist *h);
+  Hist *addHist(PossExt *pe, const BitVector *known = 0);
+  void sequence(Hist *h);
+  void release(Hist *h);
+  void enrich(Hist *h, list<EnrichedCond *> &added);
+  void extend(EnrichedCond *ec, const BitVector *only = 0);
+  void search(PossExt &pe, EnrichedCond *ec, Slots &slots, uint i);
+  void searchPre(PossExt &pe, EnrichedCond *ec, Slots &slots, uint i,
+                 vector<EnrichedCond *> &cand, uint k, bool picked);
+  bool valid(const PossExt &pe) const;
+
+  void spawn(list<EnrichedCond *> &initial);
+  void serve(int in, int out);
+  bool gather();
+  void integrate(const vector<uint> &exts);
+  void halt();
 };
 
 #endif
@@ -0,0 +1,396 @@
+#include "workers.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Room for the records of the histories. The mapping reserves no memory,
+   so this only bounds the address space it takes. */
+#define STORE_BYTES ((size_t) 1 << 32)
+
+/* Enriched conditions given to a worker at once. Smaller batches only go
+   out when the coordinator has nothing to commit until they come back. */
+#define BATCH_ECS 64
+
+/* How long the coordinator waits for the workers before looking at
+   Unfolder::cancelled again, in milliseconds. */
+#define POLL_MS 100
+
+PrefixStore::PrefixStore(size_t bytes): capacity(bytes / sizeof(uint)), used(0)
+{
+    void *p = mmap(0, bytes, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        cerr << "could not map the shared prefix store\n"; exit(1);
+    }
+    base = (uint *) p;
+}
+
+PrefixStore::~PrefixStore()
+{
+    munmap(base, capacity * sizeof(uint));
+}
+
+uint PrefixStore::append(const vector<uint> &record)
+{
+    if (record.size() > capacity - used) {
+        cerr << "shared prefix store is full\n"; exit(1);
+    }
+    uint offset = used;
+    std::copy(record.begin(), record.end(), base + used);
+    used += record.size();
+    return offset;
+}
+
+/* A possible extension as a record: its transition, its estimate, the
+   numbers of its pre- and context conditions and of its enriched
+   conditions, then their ids. */
+static void encode(vector<uint> &out, const PossExt *pe)
+{
+    out.push_back(pe->t->id);
+    out.push_back(pe->estimate);
+    out.push_back(pe->pre.size());
+    out.push_back(pe->read.size());
+    out.push_back(pe->pred.size());
+    for (vector<Cond *>::const_iterator c = pe->pre.begin(); c != pe->pre.end(); c++)
+        out.push_back((*c)->id);
+    for (vector<Cond *>::const_iterator c = pe->read.begin(); c != pe->read.end(); c++)
+        out.push_back((*c)->id);
+    for (Coset::const_iterator ec = pe->pred.begin(); ec != pe->pred.end(); ec++)
+        out.push_back((*ec)->id);
+}
+
+/* The possible extension of the record at r, with the union of its
+   histories; returns the length of the record. */
+static uint decode(const uint *r, PossExt &pe, const WorkerPool &pool, const Unf *unf)
+{
+    uint i = 5;
+    pe.t = pool.trans[r[0]];
+    pe.estimate = r[1];
+    for (uint k = 0; k < r[2]; k++)
+        pe.pre.push_back(unf->conditions[r[i++]]);
+    for (uint k = 0; k < r[3]; k++)
+        pe.read.push_back(unf->conditions[r[i++]]);
+    for (uint k = 0; k < r[4]; k++) {
+        EnrichedCond *ec = pool.ecs[r[i++]];
+        pe.pred.insert(ec);
+        pe.events |= ec->h->events;
+        pe.conflict |= ec->h->conflict;
+    }
+    pe.size = pe.events.count();
+    return i;
+}
+
+static bool bySeq(const PossExt *a, const PossExt *b)
+{
+    return a->seq < b->seq;
+}
+
+static void writeAll(int fd, const vector<uint> &msg)
+{
+    const char *p = (const char *) &msg[0];
+    size_t left = msg.size() * sizeof(uint);
+    while (left) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            cerr << "could not write to a worker pipe\n"; exit(1);
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+/* False if the pipe is closed first. */
+static bool readAll(int fd, uint *buf, size_t count)
+{
+    char *p = (char *) buf;
+    size_t left = count * sizeof(uint);
+    while (left) {
+        ssize_t n = read(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+WorkerPool::WorkerPool(Net *net): store(STORE_BYTES), unsent(0)
+{
+    for (set<Trans *>::iterator t = net->transitions.begin(); t != net->transitions.end(); t++) {
+        if ((*t)->id >= trans.size())
+            trans.resize((*t)->id + 1, (Trans *) 0);
+        trans[(*t)->id] = *t;
+    }
+}
+
+/* The record of a history is that of its possible extension, then the
+   number of places it marks and their ids. */
+void WorkerPool::record(const PossExt *pe, const Hist *h)
+{
+    vector<uint> r;
+    encode(r, pe);
+    r.push_back(h->marking.count());
+    for (int i = h->marking.next(0); i >= 0; i = h->marking.next(i + 1))
+        r.push_back(i);
+    store.append(r);
+}
+
+void WorkerPool::defer(EnrichedCond *ec)
+{
+    ecs.push_back(ec);
+    pending.push_back(ec);
+    sizes.insert(ec->h->size);
+    unsent++;
+}
+
+/* Whether pe comes before every possible extension the pending enriched
+   conditions may still yield. Those contain the history of one of them
+   and an event more, and were found later, so they lose ties on size
+   unless they are closer to the target, or with symmetry reduction, come
+   first by their Parikh vectors. */
+bool WorkerPool::safe(const PossExt *pe) const
+{
+    uint bound = *sizes.begin() + 1;
+    uint f = pe->size + pe->estimate;
+    return f < bound || (f == bound && !pe->estimate && pe->parikh.empty());
+}
+
+/* Give the oldest unsent enriched conditions to the idle workers: full
+   batches, or with all, everything, shared out among them. Each message
+   is the number of enriched conditions, the end of the store when they
+   were created, and their ids. */
+void WorkerPool::dispatch(bool all)
+{
+    uint idle = 0;
+    for (uint k = 0; k < procs.size(); k++)
+        if (!procs[k].busy)
+            idle++;
+    for (uint k = 0; k < procs.size() && unsent && idle; k++) {
+        if (procs[k].busy)
+            continue;
+        uint n = all? (unsent + idle - 1) / idle : BATCH_ECS;
+        if (n > BATCH_ECS)
+            n = BATCH_ECS;
+        if (n > unsent)
+            break;
+        vector<uint> msg;
+        msg.push_back(n);
+        msg.push_back(store.end());
+        for (uint i = pending.size() - unsent; n; i++, n--, unsent--)
+            msg.push_back(pending[i]->id);
+        writeAll(procs[k].to, msg);
+        procs[k].busy = true;
+        idle--;
+    }
+}
+
+/* Read the replies of the workers that are done, waiting for one if asked
+   to. A reply is its length, then for every enriched condition its id,
+   the length of its possible extensions and their records, in the order
+   the search found them. */
+void WorkerPool::receive(bool wait)
+{
+    vector<pollfd> fds;
+    vector<uint> which;
+    for (uint k = 0; k < procs.size(); k++)
+        if (procs[k].busy) {
+            pollfd p = { procs[k].from, POLLIN, 0 };
+            fds.push_back(p);
+            which.push_back(k);
+        }
+    if (fds.empty() || poll(&fds[0], fds.size(), wait? POLL_MS : 0) <= 0)
+        return;
+
+    for (uint i = 0; i < fds.size(); i++) {
+        if (!fds[i].revents)
+            continue;
+        Worker &w = procs[which[i]];
+        uint length;
+        vector<uint> msg;
+        bool ok = readAll(w.from, &length, 1);
+        if (ok) {
+            msg.resize(length);
+            ok = !length || readAll(w.from, &msg[0], length);
+        }
+        if (!ok) {
+            cerr << "worker process " << w.pid << " died\n"; exit(1);
+        }
+        for (uint j = 0; j + 1 < msg.size(); j += msg[j + 1] + 2)
+            results[msg[j]].assign(msg.begin() + j + 2, msg.begin() + j + 2 + msg[j + 1]);
+        w.busy = false;
+    }
+}
+
+void WorkerPool::stop()
+{
+    for (uint k = 0; k < procs.size(); k++) {
+        close(procs[k].to);
+        close(procs[k].from);
+        kill(procs[k].pid, SIGTERM);
+    }
+    for (uint k = 0; k < procs.size(); k++)
+        waitpid(procs[k].pid, 0, 0);
+    procs.clear();
+}
+
+/* Fork the workers once the initial enriched conditions exist, so that
+   their copies of the prefix start out the same as this one. */
+void Unfolder::spawn(list<EnrichedCond *> &initial)
+{
+    pool = new WorkerPool(net);
+    for (list<EnrichedCond *>::iterator it = initial.begin(); it != initial.end(); it++)
+        pool->defer(*it);
+
+    for (uint k = 0; k < workers; k++) {
+        int down[2], up[2];
+        if (pipe(down) || pipe(up)) {
+            cerr << "could not create pipe\n"; exit(1);
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            cerr << "could not create worker process\n"; exit(1);
+        }
+        if (!pid) {
+            close(down[1]);
+            close(up[0]);
+            for (uint j = 0; j < pool->procs.size(); j++) {
+                close(pool->procs[j].to);
+                close(pool->procs[j].from);
+            }
+            serve(down[0], up[1]);
+        }
+        close(down[0]);
+        close(up[1]);
+        WorkerPool::Worker w = { pid, down[1], up[0], false };
+        pool->procs.push_back(w);
+    }
+}
+
+/* The loop of a worker process, which never returns: bring the prefix up
+   to the end of the store given with the batch, building the histories
+   again as they were committed but with the markings of the store, then
+   search for the possible extensions of every enriched condition of the
+   batch. Each search only looks at enriched conditions older than its
+   own, so it finds what it would have found in the coordinator when that
+   one was created. */
+void Unfolder::serve(int in, int out)
+{
+    WorkerPool &p = *pool;
+    pool = 0;
+    listener = 0;
+    memstats = false;
+    replaying = true;
+    uint done = 0;
+
+    for (;;) {
+        uint head[2];
+        if (!readAll(in, head, 2))
+            _exit(0);
+        vector<uint> batch(head[0]);
+        if (head[0] && !readAll(in, &batch[0], head[0]))
+            _exit(0);
+
+        /* The new histories keep their orders until the batch is done,
+           since their enriched conditions are likely to be in it. */
+        vector<Hist *> fresh;
+        while (done < head[1]) {
+            PossExt pe;
+            BitVector marking;
+            const uint *r = p.store.at(done);
+            r += decode(r, pe, p, unf);
+            for (uint k = 1; k <= r[0]; k++)
+                marking.set(r[k]);
+            done = r + r[0] + 1 - p.store.at(0);
+            Hist *h = addHist(&pe, &marking);
+            if (h)
+                fresh.push_back(h);
+            if (h && !h->cutoff && !witness) {
+                list<EnrichedCond *> added;
+                enrich(h, added);
+                p.ecs.insert(p.ecs.end(), added.begin(), added.end());
+            }
+        }
+
+        vector<uint> msg(1, 0);
+        for (uint i = 0; i < batch.size(); i++) {
+            extend(p.ecs[batch[i]]);
+            vector<PossExt *> found;
+            for (; !queue.empty(); queue.pop())
+                found.push_back(queue.top());
+            sort(found.begin(), found.end(), bySeq);
+            msg.push_back(batch[i]);
+            msg.push_back(0);
+            uint at = msg.size();
+            for (uint j = 0; j < found.size(); j++) {
+                encode(msg, found[j]);
+                drop(found[j]);
+            }
+            msg[at - 1] = msg.size() - at;
+        }
+        for (uint i = 0; i < fresh.size(); i++)
+            release(fresh[i]);
+        msg[0] = msg.size() - 1;
+        writeAll(out, msg);
+    }
+}
+
+/* Wait until the possible extension on top of the queue is the one the
+   unfolding in a single process would take next, or until there is none
+   left. The extensions of the pending enriched conditions are queued in
+   the order of the conditions, which gives them the same sequence numbers
+   as there, and the prefix comes out the same. */
+bool Unfolder::gather()
+{
+    WorkerPool &p = *pool;
+    for (;;) {
+        while (p.pending.size() > p.unsent) {
+            EnrichedCond *ec = p.pending.front();
+            map<uint, vector<uint> >::iterator r = p.results.find(ec->id);
+            if (r == p.results.end())
+                break;
+            integrate(r->second);
+            p.results.erase(r);
+            p.sizes.erase(p.sizes.find(ec->h->size));
+            p.pending.pop_front();
+        }
+        if (p.pending.empty())
+            return !queue.empty();
+        if (!queue.empty() && p.safe(queue.top())) {
+            p.dispatch(false);
+            p.receive(false);
+            return true;
+        }
+        if (cancelled)
+            return false;
+        TRACE_SPAN("wait for workers");
+        p.dispatch(true);
+        p.receive(true);
+    }
+}
+
+void Unfolder::integrate(const vector<uint> &exts)
+{
+    for (uint i = 0; i < exts.size(); ) {
+        PossExt *pe = new PossExt();
+        i += decode(&exts[i], *pe, *pool, unf);
+        push(pe);
+    }
+}
+
+void Unfolder::halt()
+{
+    unextended = pool->pending.size();
+    pool->stop();
+    delete pool;
+    pool = 0;
+}
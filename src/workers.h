@@ -0,0 +1,71 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include "unf.h"
+
+#include <deque>
+#include <map>
+#include <set>
+#include <sys/types.h>
+
+/* An append-only array of uints in a shared anonymous mapping. It is
+   mapped before the worker processes are forked, so they all see what the
+   coordinator appends. Records are addressed by their offset in the array
+   and refer to the prefix by ids only, never by pointers. Only the pages
+   written to take memory. */
+class PrefixStore {
+public:
+    PrefixStore(size_t bytes);
+    ~PrefixStore();
+
+    /* Returns the offset of the record. */
+    uint append(const vector<uint> &record);
+    uint end() const { return used; }
+    const uint *at(uint offset) const { return base + offset; }
+
+private:
+    uint *base;
+    size_t capacity;    /* in uints */
+    uint used;
+
+    PrefixStore(const PrefixStore &);
+    PrefixStore &operator=(const PrefixStore &);
+};
+
+/* The worker processes of Unfolder::workers and the coordinator's view of
+   them. Every history the coordinator commits goes to the store, as its
+   transition, the ids of its conditions and enriched conditions and the
+   places it marks; a worker replays the store into its own copy of the
+   prefix before searching for the possible extensions of the enriched
+   conditions it is given, and sends them back in the same form. */
+class WorkerPool {
+public:
+    struct Worker {
+        pid_t pid;
+        int to, from;   /* pipes to and from the worker */
+        bool busy;
+    };
+
+    PrefixStore store;
+    vector<Worker> procs;
+    vector<Trans *> trans;              /* by id */
+    vector<EnrichedCond *> ecs;         /* by id */
+
+    /* Enriched conditions whose extensions are not in the queue yet, in
+       order of creation; the last unsent of them are not given out yet. */
+    deque<EnrichedCond *> pending;
+    uint unsent;
+    multiset<uint> sizes;               /* of the histories of pending */
+    map<uint, vector<uint> > results;   /* by enriched condition id */
+
+    WorkerPool(Net *net);
+
+    void record(const PossExt *pe, const Hist *h);
+    void defer(EnrichedCond *ec);
+    bool safe(const PossExt *pe) const;
+    void dispatch(bool all);
+    void receive(bool wait);
+    void stop();
+};
+
+#endif